@@ -0,0 +1,116 @@
+/*
+ * Arena vs malloc/free on a request processing style workload: every request
+ * allocates a bunch of small objects, links them up, walks them and throws
+ * everything away at the end.
+ *
+ * usage: bench_arena [REQUESTS] [OBJECTS_PER_REQUEST]
+ */
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+struct node {
+	struct node *next;
+	uint64_t value;
+};
+
+static uint64_t seed = 1337;
+
+static inline size_t next_size(void)
+{
+	seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return sizeof(struct node) + (seed >> 58) * 8; // 16 to 520 bytes
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t walk(struct node *head)
+{
+	uint64_t sum = 0;
+	for (; head; head = head->next)
+		sum += head->value;
+	return sum;
+}
+
+static uint64_t run_malloc(size_t requests, size_t objects)
+{
+	uint64_t checksum = 0;
+	for (size_t r = 0; r < requests; ++r) {
+		struct node *head = NULL;
+		for (size_t i = 0; i < objects; ++i) {
+			struct node *node = malloc(next_size());
+			node->value = i;
+			node->next = head;
+			head = node;
+		}
+
+		checksum += walk(head);
+		while (head) {
+			struct node *next = head->next;
+			free(head);
+			head = next;
+		}
+	}
+	return checksum;
+}
+
+static uint64_t run_arena(size_t requests, size_t objects)
+{
+	uint64_t checksum = 0;
+	for (size_t r = 0; r < requests; ++r) {
+		struct __1337_arena arena = { 0 };
+		struct node *head = NULL;
+		for (size_t i = 0; i < objects; ++i) {
+			struct node *node = __1337_arena_alloc(&arena, next_size(), _Alignof(struct node));
+			node->value = i;
+			node->next = head;
+			head = node;
+		}
+
+		checksum += walk(head);
+		__1337_arena_release(&arena);
+	}
+	return checksum;
+}
+
+int main(int argc, char **argv)
+{
+	size_t requests = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000;
+	size_t objects = argc > 2 ? strtoull(argv[2], NULL, 10) : 500;
+	double start, malloc_time, arena_time;
+	uint64_t malloc_sum, arena_sum;
+
+	// Warm up both allocators
+	run_malloc(requests / 10 + 1, objects);
+	run_arena(requests / 10 + 1, objects);
+
+	seed = 1337;
+	start = now();
+	malloc_sum = run_malloc(requests, objects);
+	malloc_time = now() - start;
+
+	seed = 1337;
+	start = now();
+	arena_sum = run_arena(requests, objects);
+	arena_time = now() - start;
+
+	if (malloc_sum != arena_sum) {
+		fprintf(stderr, "checksum mismatch\n");
+		return 1;
+	}
+
+	double allocs = (double)requests * objects;
+	printf("requests: %zu, objects per request: %zu\n", requests, objects);
+	printf("malloc/free: %8.3f s (%6.2f ns/object)\n", malloc_time, malloc_time * 1e9 / allocs);
+	printf("arena:       %8.3f s (%6.2f ns/object)\n", arena_time, arena_time * 1e9 / allocs);
+	printf("speedup:     %8.2fx\n", malloc_time / arena_time);
+
+	return 0;
+}
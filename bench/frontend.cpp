@@ -0,0 +1,164 @@
+/*
+ * Front end throughput on generated programs (generator.hpp): lexing
+ * (`Lexer::tokenize`), parsing (`Parser::parse_expression`) and generating
+ * IR (`Codegen::predeclare` and `Codegen::include`, without optimizations).
+ *
+ * Prints one JSON object per benchmark and shape, so the results of two
+ * commits can be compared line by line. Times are the best and the median
+ * of the repetitions, allocations are those of one repetition.
+ *
+ * usage: bench_frontend [--shape=NAME] [--size=BYTES] [--seed=N] [--reps=N]
+ *                       [--depth=N] [--params=N] [--emit=FILE]
+ *
+ * --emit writes the program of --shape to FILE instead of benchmarking it.
+ */
+#include "generator.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <functional>
+
+struct Result {
+	std::vector<uint64_t> wall_ns;
+	PhaseSample last; // Of the last repetition
+};
+
+// The setup isn't measured, only `body`. Both run once per repetition.
+static Result measure(size_t reps, const std::function<void()> &setup, const std::function<void()> &body)
+{
+	Result result;
+	for (size_t i = 0; i < reps; ++i) {
+		setup();
+		auto start = PhaseSample::now();
+		body();
+		result.last = PhaseSample::now() - start;
+		result.wall_ns.push_back(result.last.wall_ns);
+	}
+	std::sort(result.wall_ns.begin(), result.wall_ns.end());
+	return result;
+}
+
+static void report(const char *bench, Shape shape, const Program &program, size_t units, const char *unit, Result &result)
+{
+	auto best = std::max<uint64_t>(result.wall_ns.front(), 1);
+	auto median = result.wall_ns[result.wall_ns.size() / 2];
+	std::cout << "{\"bench\":\"" << bench << "\",\"shape\":\"" << shape_names[static_cast<int>(shape)]
+		<< "\",\"bytes\":" << program.source.size() << ",\"nodes\":" << program.nodes
+		<< ",\"" << unit << "\":" << units << ",\"reps\":" << result.wall_ns.size()
+		<< ",\"best_ns\":" << best << ",\"median_ns\":" << median
+		<< ",\"mb_per_s\":" << program.source.size() / (best / 1e9) / 1e6
+		<< ",\"nodes_per_s\":" << program.nodes / (best / 1e9)
+		<< ",\"allocations\":" << result.last.allocations
+		<< ",\"allocated_bytes\":" << result.last.allocated_bytes << "}" << std::endl;
+}
+
+static std::vector<std::unique_ptr<ExprAst>> parse(const std::string &source, bool &finished)
+{
+	std::vector<std::unique_ptr<ExprAst>> exprs;
+	auto parser = Parser(source, "<generated>");
+	while (auto expr = parser.parse_expression())
+		exprs.push_back(std::move(expr));
+	finished = parser.is_finished();
+	return exprs;
+}
+
+static bool run(Shape shape, const Program &program, size_t reps)
+{
+	// Lexer::tokenize until the end of the file
+	size_t tokens = 0;
+	std::optional<Lexer> lexer;
+	auto lexing = measure(reps, [&]() { lexer.emplace(program.source, "<generated>"); tokens = 0; }, [&]() {
+		for (auto token = lexer->tokenize(); token && token->type != TokenType::Eof; token = lexer->tokenize())
+			++tokens;
+	});
+	report("lex", shape, program, tokens, "tokens", lexing);
+
+	// Parser::parse_expression, which pulls the tokens from the lexer as it goes
+	std::vector<std::unique_ptr<ExprAst>> exprs;
+	bool finished = false;
+	auto parsing = measure(reps, [&]() { exprs.clear(); }, [&]() { exprs = parse(program.source, finished); });
+	if (!finished) {
+		std::cout << "[ERR] Failed to parse the generated " << shape_names[static_cast<int>(shape)] << " program" << std::endl;
+		return false;
+	}
+	report("parse", shape, program, exprs.size(), "declarations", parsing);
+
+	// Codegen::include on a fresh module, the AST is parsed again outside of the measurement
+	std::optional<Codegen> codegen;
+	bool generated = true;
+	auto generating = measure(reps, [&]() {
+		codegen.reset();
+		exprs = parse(program.source, finished);
+		codegen.emplace();
+	}, [&]() {
+		for (auto &expr : exprs)
+			generated &= codegen->predeclare(expr.get());
+		for (auto &expr : exprs)
+			generated &= codegen->include(expr.get());
+	});
+	if (!generated) {
+		std::cout << "[ERR] Failed to generate the " << shape_names[static_cast<int>(shape)] << " program" << std::endl;
+		return false;
+	}
+	report("codegen", shape, program, exprs.size(), "declarations", generating);
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	GeneratorOptions options;
+	std::vector<Shape> shapes = { Shape::Functions, Shape::Expressions, Shape::Strings, Shape::Params };
+	size_t reps = 10;
+	std::string emit;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		auto value = arg.substr(arg.find('=') + 1);
+		if (arg.rfind("--shape=", 0) == 0) {
+			auto name = std::find_if(std::begin(shape_names), std::end(shape_names), [&](auto n) { return value == n; });
+			if (name == std::end(shape_names)) {
+				std::cout << "[ERR] Unknown shape '" << value << "'" << std::endl;
+				return 1;
+			}
+			shapes = { static_cast<Shape>(name - std::begin(shape_names)) };
+		} else if (arg.rfind("--size=", 0) == 0) {
+			options.size = std::stoull(value);
+		} else if (arg.rfind("--seed=", 0) == 0) {
+			options.seed = std::stoull(value);
+		} else if (arg.rfind("--reps=", 0) == 0) {
+			reps = std::max<size_t>(std::stoull(value), 1);
+		} else if (arg.rfind("--depth=", 0) == 0) {
+			options.depth = std::stoul(value);
+		} else if (arg.rfind("--params=", 0) == 0) {
+			options.params = std::max<unsigned long>(std::stoul(value), 1);
+		} else if (arg.rfind("--emit=", 0) == 0) {
+			emit = value;
+		} else {
+			std::cout << "usage: bench_frontend [--shape=functions|expressions|strings|params] [--size=BYTES] [--seed=N] [--reps=N] [--depth=N] [--params=N] [--emit=FILE]" << std::endl;
+			return 1;
+		}
+	}
+
+	auto generator = Generator(options);
+	if (!emit.empty()) {
+		if (shapes.size() != 1) {
+			std::cout << "[ERR] --emit needs a --shape" << std::endl;
+			return 1;
+		}
+		std::ofstream(emit) << generator.generate(shapes[0]).source;
+		return 0;
+	}
+
+	for (auto shape : shapes) {
+		if (!run(shape, generator.generate(shape), reps))
+			return 1;
+	}
+
+	return 0;
+}
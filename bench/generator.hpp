@@ -0,0 +1,208 @@
+#ifndef _BENCH_GENERATOR_HPP_
+#define _BENCH_GENERATOR_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Deterministic generator of 1337 programs for the front end benchmarks. The same shape,
+ * size and seed always give the same program, on every machine, so the numbers of two
+ * commits are measured on the same input.
+ *
+ * Every program compiles: the functions only call the ones generated before them and
+ * `main` calls the last one. `nodes` counts the expressions, types and parameters the
+ * generator wrote, a unit for nodes/s that stays the same from commit to commit.
+ */
+enum class Shape: int {
+	Functions,   // Many small functions calling each other
+	Expressions, // Few functions, each one a deep tree of binary operators
+	Strings,     // Long string literals, globals and `printf` arguments
+	Params,      // Functions with long parameter lists, called with as many arguments
+};
+
+static const char *shape_names[] = { "functions", "expressions", "strings", "params" };
+
+struct Program {
+	std::string source;
+	size_t nodes = 0;
+};
+
+struct GeneratorOptions {
+	size_t size = 1 << 20; // Bytes of source, the last function may go over it
+	uint64_t seed = 1337;
+	unsigned int depth = 10; // Of the operator trees of `Shape::Expressions`
+	unsigned int params = 64; // Per function of `Shape::Params`
+	size_t string_length = 4096; // Per literal of `Shape::Strings`
+};
+
+class Generator {
+private:
+	GeneratorOptions options;
+	uint64_t state;
+	Program program;
+	size_t functions = 0;
+	size_t arity = 0; // Of the last function
+public:
+	inline Generator(GeneratorOptions options)
+		: options(options), state(options.seed)
+	{}
+
+	inline Program generate(Shape shape)
+	{
+		this->state = this->options.seed;
+		this->program = {};
+		this->functions = 0;
+		this->arity = 0;
+
+		this->program.source = "# Generated, shape " + std::string(shape_names[static_cast<int>(shape)]) + "\n";
+		while (this->program.source.size() < this->options.size) {
+			switch (shape) {
+			case Shape::Functions:
+				this->small_function();
+				break;
+			case Shape::Expressions:
+				this->expression_function();
+				break;
+			case Shape::Strings:
+				this->string_function();
+				break;
+			case Shape::Params:
+				this->params_function();
+				break;
+			}
+		}
+		this->main();
+
+		return std::move(this->program);
+	}
+private:
+	// PCG style LCG, like bench/arena.c, the high bits are the random ones
+	inline uint64_t next(uint64_t bound)
+	{
+		this->state = this->state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (this->state >> 33) % bound;
+	}
+
+	inline std::string previous()
+	{
+		return "f" + std::to_string(this->functions - 1);
+	}
+
+	inline void emit(const std::string &text, size_t nodes)
+	{
+		this->program.source += text;
+		this->program.nodes += nodes;
+	}
+
+	// Declaration, function, prototype, its type and the codeblock
+	inline void begin_function(const std::string &params, size_t param_count)
+	{
+		this->emit("f" + std::to_string(this->functions) + " := fn i64 (" + params + ") {\n", 5 + param_count * 2);
+		this->arity = param_count;
+	}
+
+	inline void end_function()
+	{
+		this->emit("}\n\n", 0);
+		++this->functions;
+	}
+
+	// f<n> := fn i64 (a: i64, b: i64) { x := a * 3 + b; f<n - 1>(x, b) - a }
+	inline void small_function()
+	{
+		this->begin_function("a: i64, b: i64", 2);
+		auto k = std::to_string(this->next(9) + 1);
+		this->emit("\tx := a * " + k + " + b\n", 7);
+		if (this->functions > 0)
+			this->emit("\t" + this->previous() + "(x, b) - a\n", 5);
+		else
+			this->emit("\tx - a\n", 3);
+		this->end_function();
+	}
+
+	// Constants are only right operands, so every subtree has a parameter to take its type from
+	inline void tree(unsigned int depth, bool right = false)
+	{
+		if (depth == 0) {
+			static const char *leaves[] = { "a", "b", "c" };
+			auto leaf = this->next(right ? 4 : 3);
+			this->emit(leaf < 3 ? leaves[leaf] : std::to_string(this->next(100) + 1), 1);
+			return;
+		}
+
+		static const char *ops[] = { " + ", " - ", " * " };
+		this->emit("(", 1);
+		this->tree(depth - 1);
+		this->emit(ops[this->next(3)], 0);
+		this->tree(depth - 1, true);
+		this->emit(")", 0);
+	}
+
+	inline void expression_function()
+	{
+		this->begin_function("a: i64, b: i64, c: i64", 3);
+		this->emit("\t", 0);
+		this->tree(this->options.depth);
+		this->emit("\n", 0);
+		this->end_function();
+	}
+
+	inline std::string literal()
+	{
+		static const char letters[] = "abcdefghijklmnopqrstuvwxyz ";
+		std::string str = "\"";
+		for (size_t i = 0; i < this->options.string_length; ++i)
+			str += letters[this->next(sizeof(letters) - 1)];
+		return str + "\"";
+	}
+
+	// s<n> := "..." and a function printing it and another literal
+	inline void string_function()
+	{
+		auto name = "s" + std::to_string(this->functions);
+		this->emit(name + " := " + this->literal() + "\n", 3);
+		this->begin_function("a: i64, b: i64", 2);
+		this->emit("\tprintf(" + name + ")\n", 2);
+		this->emit("\tprintf(" + this->literal() + ")\n", 2);
+		this->emit("\ta + b\n", 3);
+		this->end_function();
+	}
+
+	// f<n> := fn i64 (p0: i64, ...) { f<n - 1>(p<k>, ...) + p0 + ... }
+	inline void params_function()
+	{
+		std::string params;
+		for (unsigned int i = 0; i < this->options.params; ++i)
+			params += (i ? ", p" : "p") + std::to_string(i) + ": i64";
+		this->begin_function(params, this->options.params);
+
+		this->emit("\t", 0);
+		if (this->functions > 0) {
+			std::string args;
+			for (unsigned int i = 0; i < this->options.params; ++i)
+				args += (i ? ", p" : "p") + std::to_string(this->next(this->options.params));
+			this->emit(this->previous() + "(" + args + ") + ", 2 + this->options.params);
+		}
+		std::string sum;
+		for (unsigned int i = 0; i < this->options.params; ++i)
+			sum += (i ? " + p" : "p") + std::to_string(i);
+		this->emit(sum + "\n", this->options.params * 2 - 1);
+		this->end_function();
+	}
+
+	inline void main()
+	{
+		this->emit("main := fn i32 () {\n", 5);
+		if (this->functions > 0) {
+			std::string list;
+			for (size_t i = 0; i < this->arity; ++i)
+				list += i ? ", 1" : "1";
+			this->emit("\tprintf(\"%ld\\n\", " + this->previous() + "(" + list + "))\n", 3 + this->arity);
+		}
+		this->emit("\t0\n}\n", 1);
+	}
+};
+
+#endif
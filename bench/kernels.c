@@ -0,0 +1,50 @@
+/*
+ * The kernels of kernels.1337 in C. Built by the clang of the LLVM the compiler
+ * uses, at the same -O level, in its own object so the driver can't inline them.
+ */
+#include <stdint.h>
+
+int64_t c_int_loop(int64_t n)
+{
+	int64_t acc = 0;
+	for (int64_t i = 1; i <= n; ++i) {
+		int64_t x = i, steps = 0;
+		while (x != 1) {
+			x = x % 2 == 0 ? x / 2 : 3 * x + 1;
+			++steps;
+		}
+		acc += steps;
+	}
+	return acc;
+}
+
+double c_float_reduce(double n)
+{
+	double acc = 0.0;
+	for (double x = 1.0; x <= n; x += 1.0)
+		acc += 1.0 / (x * x);
+	return acc;
+}
+
+int64_t c_fib(int64_t n)
+{
+	if (n < 2)
+		return n;
+	return c_fib(n - 1) + c_fib(n - 2);
+}
+
+int64_t c_string_scan(const char *s, int64_t n, char c)
+{
+	int64_t count = 0;
+	for (int64_t i = 0; i < n; ++i)
+		count += s[i] == c;
+	return count;
+}
+
+int64_t c_array_sum(const int64_t *xs, int64_t n)
+{
+	int64_t sum = 0;
+	for (int64_t i = 0; i < n; ++i)
+		sum += xs[i];
+	return sum;
+}
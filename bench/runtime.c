@@ -0,0 +1,116 @@
+/*
+ * How fast the code 1337 generates runs, next to the same kernels in C:
+ * integer loops, a float reduction, recursion, string scanning and array
+ * traversal. Both sides are built by the same LLVM at the same -O level
+ * for the same (generic) CPU, so the ratio is down to the code each front
+ * end hands to LLVM. Each time is the best of REPS runs.
+ *
+ * usage: bench_runtime [SCALE] [REPS]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+// kernels.1337
+int64_t int_loop(int64_t n);
+double float_reduce(double n);
+int64_t fib(int64_t n);
+void *chars(int64_t n);
+void set_char(void *xs, int64_t i, char c);
+void release_chars(void *xs);
+int64_t string_scan(void *xs, char c);
+void *cells(int64_t n);
+void set_cell(void *xs, int64_t i, int64_t v);
+void release_cells(void *xs);
+int64_t array_sum(void *xs);
+
+// kernels.c
+int64_t c_int_loop(int64_t n);
+double c_float_reduce(double n);
+int64_t c_fib(int64_t n);
+int64_t c_string_scan(const char *s, int64_t n, char c);
+int64_t c_array_sum(const int64_t *xs, int64_t n);
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t scale, reps;
+static int64_t text_len, array_len;
+static char *text;
+static int64_t *array;
+static void *text_soa, *array_soa;
+
+// The results are checked against each other, and keep the calls from being dropped
+static double run(int kernel, int c)
+{
+	switch (kernel) {
+	case 0: return c ? c_int_loop(scale * 100000) : int_loop(scale * 100000);
+	case 1: return c ? c_float_reduce(scale * 10000000.0) : float_reduce(scale * 10000000.0);
+	case 2: return c ? c_fib(30) : fib(30);
+	case 3: return c ? c_string_scan(text, text_len, 'e') : string_scan(text_soa, 'e');
+	case 4: return c ? c_array_sum(array, array_len) : array_sum(array_soa);
+	}
+	return 0;
+}
+
+static const char *names[] = { "int_loop", "float_reduce", "fib", "string_scan", "array_sum" };
+
+int main(int argc, char **argv)
+{
+	scale = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+	reps = argc > 2 ? strtoull(argv[2], NULL, 10) : 5;
+	text_len = scale * (1 << 24);
+	array_len = scale * (1 << 22);
+
+	uint64_t seed = 1337;
+	text = malloc(text_len);
+	text_soa = chars(text_len);
+	for (int64_t i = 0; i < text_len; ++i) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		text[i] = "etaoin shrdlu"[(seed >> 33) % 13];
+		set_char(text_soa, i, text[i]);
+	}
+	array = malloc(array_len * sizeof(int64_t));
+	array_soa = cells(array_len);
+	for (int64_t i = 0; i < array_len; ++i) {
+		array[i] = i * 7 - 3;
+		set_cell(array_soa, i, array[i]);
+	}
+
+	printf("scale: %zu, reps: %zu\n", scale, reps);
+	printf("%-14s %10s %10s %8s\n", "kernel", "1337 ms", "C ms", "1337/C");
+	double log_ratios = 0.0;
+	int mismatches = 0;
+	for (int kernel = 0; kernel < 5; ++kernel) {
+		double best[2] = { INFINITY, INFINITY }, result[2];
+		for (size_t r = 0; r < reps; ++r) {
+			for (int c = 0; c < 2; ++c) {
+				double start = now();
+				result[c] = run(kernel, c);
+				double time = now() - start;
+				if (time < best[c])
+					best[c] = time;
+			}
+		}
+
+		if (result[0] != result[1]) {
+			fprintf(stderr, "%s: result mismatch, 1337 %f, C %f\n", names[kernel], result[0], result[1]);
+			++mismatches;
+		}
+		log_ratios += log(best[0] / best[1]);
+		printf("%-14s %10.3f %10.3f %8.2f\n", names[kernel], best[0] * 1e3, best[1] * 1e3, best[0] / best[1]);
+	}
+	printf("%-14s %10s %10s %8.2f\n", "geomean", "", "", exp(log_ratios / 5));
+
+	release_chars(text_soa);
+	release_cells(array_soa);
+	free(text);
+	free(array);
+	return mismatches ? 1 : 0;
+}
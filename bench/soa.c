@@ -0,0 +1,98 @@
+/*
+ * Structure of arrays vs array of structs on loops that only touch a few fields of
+ * a 64 byte struct. The structure of arrays side is `soa<Particle>` from soa.1337,
+ * the array of structs side is the same loops in C.
+ *
+ * usage: bench_soa [PARTICLES] [REPS]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+struct particle {
+	int64_t id;
+	double x, y, z;
+	double vx, vy, vz;
+	double mass;
+};
+
+// soa.1337
+void *particles(int64_t n);
+void release(void *xs);
+void set(void *xs, int64_t i, int64_t id, double x, double vx);
+double position(void *xs, int64_t i);
+int64_t total_ids(void *xs);
+void advance(void *xs, double dt);
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int64_t aos_total_ids(struct particle *ps, size_t n)
+{
+	int64_t sum = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += ps[i].id;
+	return sum;
+}
+
+static void aos_advance(struct particle *ps, size_t n, double dt)
+{
+	for (size_t i = 0; i < n; ++i)
+		ps[i].x = ps[i].x + ps[i].vx * dt;
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+	size_t reps = argc > 2 ? strtoull(argv[2], NULL, 10) : 200;
+	double start, aos_sum_time, soa_sum_time, aos_step_time, soa_step_time;
+	int64_t aos_sum = 0, soa_sum = 0;
+
+	struct particle *ps = aligned_alloc(64, n * sizeof(struct particle));
+	void *xs = particles(n);
+	for (size_t i = 0; i < n; ++i) {
+		ps[i] = (struct particle) { i, i * 0.5, i * 0.5, i * 0.5, 1.0, 1.0, 1.0, 1.0 };
+		set(xs, i, i, i * 0.5, 1.0);
+	}
+
+	start = now();
+	for (size_t r = 0; r < reps; ++r)
+		aos_sum += aos_total_ids(ps, n);
+	aos_sum_time = now() - start;
+
+	start = now();
+	for (size_t r = 0; r < reps; ++r)
+		soa_sum += total_ids(xs);
+	soa_sum_time = now() - start;
+
+	start = now();
+	for (size_t r = 0; r < reps; ++r)
+		aos_advance(ps, n, 0.01);
+	aos_step_time = now() - start;
+
+	start = now();
+	for (size_t r = 0; r < reps; ++r)
+		advance(xs, 0.01);
+	soa_step_time = now() - start;
+
+	if (aos_sum != soa_sum || ps[n - 1].x != position(xs, n - 1)) {
+		fprintf(stderr, "checksum mismatch\n");
+		return 1;
+	}
+
+	double elements = (double)n * reps;
+	printf("particles: %zu, reps: %zu\n", n, reps);
+	printf("sum of one field:   aos %8.3f s (%5.2f ns/particle), soa %8.3f s (%5.2f ns/particle), %5.2fx\n",
+	       aos_sum_time, aos_sum_time * 1e9 / elements, soa_sum_time, soa_sum_time * 1e9 / elements, aos_sum_time / soa_sum_time);
+	printf("update two fields:  aos %8.3f s (%5.2f ns/particle), soa %8.3f s (%5.2f ns/particle), %5.2fx\n",
+	       aos_step_time, aos_step_time * 1e9 / elements, soa_step_time, soa_step_time * 1e9 / elements, aos_step_time / soa_step_time);
+
+	release(xs);
+	free(ps);
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * End to end latency of the compiler on a small file: process creation,
+ * dynamic loading, LLVM initialization, compiling and writing the object,
+ * as a build system or an editor sees it. The compiler's output goes to
+ * /dev/null and its object into the working directory.
+ *
+ * usage: bench_startup COMPILER SOURCE [REPS] [ARGS...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int by_value(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: bench_startup COMPILER SOURCE [REPS] [ARGS...]\n");
+		return 1;
+	}
+	size_t reps = argc > 3 ? strtoull(argv[3], NULL, 10) : 50;
+	if (reps == 0)
+		reps = 1;
+
+	// COMPILER [ARGS...] SOURCE
+	int extra = argc > 4 ? argc - 4 : 0;
+	char **args = calloc(extra + 3, sizeof(*args));
+	args[0] = argv[1];
+	memcpy(args + 1, argv + 4, extra * sizeof(*args));
+	args[extra + 1] = argv[2];
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+	double *times = calloc(reps, sizeof(*times));
+	for (size_t i = 0; i < reps; ++i) {
+		pid_t pid;
+		int status;
+		double start = now();
+		if (posix_spawn(&pid, args[0], &actions, NULL, args, environ) != 0) {
+			perror("posix_spawn");
+			return 1;
+		}
+		waitpid(pid, &status, 0);
+		times[i] = now() - start;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "%s failed on %s\n", args[0], argv[2]);
+			return 1;
+		}
+	}
+
+	qsort(times, reps, sizeof(*times), by_value);
+	printf("{\"bench\":\"startup\",\"source\":\"%s\",\"reps\":%zu,\"best_ms\":%.3f,\"median_ms\":%.3f}\n",
+	       argv[2], reps, times[0] * 1e3, times[reps / 2] * 1e3);
+
+	posix_spawn_file_actions_destroy(&actions);
+	free(times);
+	free(args);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * 1337c, a drop in for `1337` that has a running `1337 --server` do the
+ * compiling (src/server.hpp). It takes the same arguments, sends them with
+ * the working directory, prints what the compile printed and exits with its
+ * exit code.
+ *
+ * Without a server it runs the compiler itself, `$LEET_COMPILER` or the
+ * `1337` next to this executable, so it can always stand in for `1337`. The
+ * socket is `$LEET_SOCKET`, or the one the server listens on by default.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int read_all(int fd, void *data, size_t size)
+{
+	char *bytes = data;
+	while (size > 0) {
+		ssize_t n = read(fd, bytes, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		bytes += n;
+		size -= n;
+	}
+	return 1;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+	const char *bytes = data;
+	while (size > 0) {
+		ssize_t n = write(fd, bytes, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		bytes += n;
+		size -= n;
+	}
+	return 1;
+}
+
+static int write_string(int fd, const char *str)
+{
+	uint32_t size = strlen(str);
+	return write_all(fd, &size, sizeof(size)) && write_all(fd, str, size);
+}
+
+// Copies a string of the response to `out`
+static int forward(int fd, FILE *out)
+{
+	uint32_t size;
+	if (!read_all(fd, &size, sizeof(size)))
+		return 0;
+	char *str = malloc(size ? size : 1);
+	if (!str || !read_all(fd, str, size)) {
+		free(str);
+		return 0;
+	}
+	fwrite(str, 1, size, out);
+	free(str);
+	return 1;
+}
+
+static void run_compiler(char **argv)
+{
+	char path[PATH_MAX];
+	const char *compiler = getenv("LEET_COMPILER");
+	if (!compiler) {
+		ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - sizeof("/1337"));
+		if (n > 0) {
+			path[n] = '\0';
+			strcat(dirname(path), "/1337");
+			compiler = path;
+		} else {
+			compiler = "1337";
+		}
+	}
+
+	argv[0] = (char *)compiler;
+	execvp(compiler, argv);
+	fprintf(stderr, "1337c: no server and failed to run '%s': %s\n", compiler, strerror(errno));
+	exit(1);
+}
+
+static int connect_server(void)
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	const char *socket_path = getenv("LEET_SOCKET");
+	const char *runtime = getenv("XDG_RUNTIME_DIR");
+	int length;
+	if (socket_path)
+		length = snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+	else if (runtime && *runtime)
+		length = snprintf(address.sun_path, sizeof(address.sun_path), "%s/1337.sock", runtime);
+	else
+		length = snprintf(address.sun_path, sizeof(address.sun_path), "/tmp/1337-%u.sock", (unsigned int)getuid());
+	if (length < 0 || (size_t)length >= sizeof(address.sun_path))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	char cwd[PATH_MAX];
+	// The server itself is only started by the compiler
+	if (argc > 1 && strcmp(argv[1], "--server") == 0)
+		run_compiler(argv);
+
+	int fd = connect_server();
+	if (fd < 0 || !getcwd(cwd, sizeof(cwd)))
+		run_compiler(argv);
+
+	uint32_t count = argc;
+	int sent = write_all(fd, &count, sizeof(count)) && write_string(fd, cwd);
+	for (int i = 1; sent && i < argc; ++i)
+		sent = write_string(fd, argv[i]);
+
+	// Nothing was printed yet if the server went away before its response
+	int32_t status;
+	if (!sent || !read_all(fd, &status, sizeof(status))) {
+		close(fd);
+		run_compiler(argv);
+	}
+	int complete = forward(fd, stdout) && fflush(stdout) == 0 && forward(fd, stderr);
+	close(fd);
+	if (!complete) {
+		fprintf(stderr, "1337c: the server closed the connection\n");
+		return 1;
+	}
+	return status;
+}
@@ -0,0 +1,83 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_SIZE (64 * 1024)
+#define LARGE_SIZE (CHUNK_SIZE / 4) // Allocations above this get their own chunk
+#define FREE_CHUNKS_MAX 64 // Chunks each thread keeps around for the next arena
+
+// Released chunks go back to a per thread list, so arenas on a hot path
+// don't hit malloc at all after warming up and never contend on a lock
+static _Thread_local struct __1337_arena_chunk *free_chunks = NULL;
+static _Thread_local size_t free_count = 0;
+
+static inline char *align_up(void *ptr, size_t align)
+{
+	return (char *)(((uintptr_t)ptr + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+// Like the fast path, the address is aligned, not its offset into the chunk: malloc only
+// guarantees 16 bytes, `@align(64)` structs need more
+void *__1337_arena_alloc_slow(struct __1337_arena *arena, size_t size, size_t align)
+{
+	struct __1337_arena_chunk *chunk;
+
+	if (size + align > LARGE_SIZE) {
+		chunk = malloc(sizeof(struct __1337_arena_chunk) + align - 1 + size);
+		if (!chunk)
+			return NULL;
+
+		chunk->next = arena->large;
+		arena->large = chunk;
+		return align_up(chunk + 1, align);
+	}
+
+	if (free_chunks) {
+		chunk = free_chunks;
+		free_chunks = chunk->next;
+		--free_count;
+	} else {
+		chunk = malloc(CHUNK_SIZE);
+		if (!chunk)
+			return NULL;
+	}
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	if (!arena->last)
+		arena->last = chunk;
+	++arena->nchunks;
+
+	char *ptr = align_up(chunk + 1, align);
+	arena->cursor = ptr + size;
+	arena->end = (char *)chunk + CHUNK_SIZE;
+
+	return ptr;
+}
+
+void __1337_arena_release(struct __1337_arena *arena)
+{
+	struct __1337_arena_chunk *chunk, *next;
+
+	if (arena->chunks) {
+		arena->last->next = free_chunks;
+		free_chunks = arena->chunks;
+		free_count += arena->nchunks;
+	}
+
+	// Only trims when a thread has been running unusually big arenas
+	while (free_count > FREE_CHUNKS_MAX) {
+		chunk = free_chunks;
+		free_chunks = chunk->next;
+		--free_count;
+		free(chunk);
+	}
+
+	for (chunk = arena->large; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,40 @@
+#ifndef _1337_ARENA_H_
+#define _1337_ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * Region allocator backing `arena name { ... }` scopes.
+ *
+ * The bump pointer fast path (`cursor`/`end`) is inlined by the compiler, only
+ * `__1337_arena_alloc_slow` and `__1337_arena_release` are called out of line.
+ * A zeroed arena is a valid empty arena.
+ */
+struct __1337_arena_chunk {
+	struct __1337_arena_chunk *next;
+};
+
+struct __1337_arena {
+	char *cursor; // Must stay the first two fields, the compiler accesses them directly
+	char *end;
+	struct __1337_arena_chunk *chunks; // Standard sized chunks, newest first
+	struct __1337_arena_chunk *last;   // Oldest chunk, so the list can be spliced in O(1)
+	struct __1337_arena_chunk *large;  // Dedicated chunks for big allocations
+	size_t nchunks;
+};
+
+void *__1337_arena_alloc_slow(struct __1337_arena *arena, size_t size, size_t align);
+void __1337_arena_release(struct __1337_arena *arena);
+
+static inline void *__1337_arena_alloc(struct __1337_arena *arena, size_t size, size_t align)
+{
+	char *ptr = (char *)(((size_t)arena->cursor + align - 1) & ~(align - 1));
+	if (arena->cursor && ptr <= arena->end && (size_t)(arena->end - ptr) >= size) {
+		arena->cursor = ptr + size;
+		return ptr;
+	}
+
+	return __1337_arena_alloc_slow(arena, size, align);
+}
+
+#endif
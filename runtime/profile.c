@@ -0,0 +1,175 @@
+#include "profile.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct counters {
+	uint64_t calls;
+	uint64_t inclusive; // Ticks, recursive calls are only counted once, by the outermost one
+	uint64_t exclusive; // Ticks, without the instrumented callees
+	uint64_t active; // Calls on the stack right now
+};
+
+struct thread_profile {
+	struct counters *counters; // Indexed by id
+	uint64_t size;
+	struct thread_profile *next;
+};
+
+// Registration and the first call of each thread take the lock, the counters never do
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const char **names = NULL; // Of every registered function, indexed by id
+static uint64_t count = 0;
+static struct thread_profile *threads = NULL; // Kept after the threads exit, their counts still matter
+static uint64_t start_ticks;
+static struct timespec start_time;
+
+static _Thread_local struct thread_profile *self = NULL;
+static _Thread_local struct __1337_profile_frame *current = NULL;
+
+// The invariant TSC (or the virtual counter on ARM) is read without serializing,
+// the ticks are converted to time at exit against the monotonic clock
+static inline uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t value;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(value));
+	return value;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+struct row {
+	const char *name;
+	uint64_t calls;
+	uint64_t inclusive;
+	uint64_t exclusive;
+};
+
+static int by_exclusive(const void *a, const void *b)
+{
+	const struct row *x = a, *y = b;
+	return x->exclusive < y->exclusive ? 1 : x->exclusive > y->exclusive ? -1 : 0;
+}
+
+static void dump(void)
+{
+	struct timespec end_time;
+	uint64_t end_ticks = ticks();
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	double elapsed_ns = (end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_nsec - start_time.tv_nsec);
+	double ms_per_tick = end_ticks > start_ticks ? elapsed_ns / (end_ticks - start_ticks) / 1e6 : 0.0;
+
+	pthread_mutex_lock(&lock);
+	struct row *rows = calloc(count, sizeof(*rows));
+	if (!rows) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	size_t nthreads = 0;
+	for (struct thread_profile *thread = threads; thread; thread = thread->next, ++nthreads) {
+		for (uint64_t id = 0; id < thread->size; ++id) {
+			rows[id].calls += thread->counters[id].calls;
+			rows[id].inclusive += thread->counters[id].inclusive;
+			rows[id].exclusive += thread->counters[id].exclusive;
+		}
+	}
+	for (uint64_t id = 0; id < count; ++id)
+		rows[id].name = names[id];
+	size_t nrows = count;
+	pthread_mutex_unlock(&lock);
+
+	qsort(rows, nrows, sizeof(*rows), by_exclusive);
+	uint64_t total = 0;
+	for (size_t i = 0; i < nrows; ++i)
+		total += rows[i].exclusive;
+
+	fprintf(stderr, "Flat profile: %zu thread(s), %.3f ms in instrumented functions\n", nthreads, total * ms_per_tick);
+	fprintf(stderr, "%7s %12s %12s %12s  %s\n", "%time", "self ms", "total ms", "calls", "function");
+	for (size_t i = 0; i < nrows && rows[i].calls > 0; ++i) {
+		fprintf(stderr, "%6.2f%% %12.3f %12.3f %12llu  %s\n", total ? 100.0 * rows[i].exclusive / total : 0.0,
+		        rows[i].exclusive * ms_per_tick, rows[i].inclusive * ms_per_tick,
+		        (unsigned long long)rows[i].calls, rows[i].name);
+	}
+	free(rows);
+}
+
+void __1337_profile_register(const char *const *module_names, uint64_t module_count, uint64_t *base)
+{
+	pthread_mutex_lock(&lock);
+	if (!names) {
+		start_ticks = ticks();
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+		atexit(dump);
+	}
+
+	const char **grown = realloc(names, (count + module_count + 1) * sizeof(*names));
+	if (!grown)
+		abort();
+	names = grown;
+	memcpy(names + count, module_names, module_count * sizeof(*names));
+	*base = count;
+	count += module_count;
+	pthread_mutex_unlock(&lock);
+}
+
+// First call of a thread, or the first one after another module registered
+static struct thread_profile *grow(uint64_t id)
+{
+	pthread_mutex_lock(&lock);
+	if (!self) {
+		self = calloc(1, sizeof(*self));
+		if (!self)
+			abort();
+		self->next = threads;
+		threads = self;
+	}
+
+	uint64_t size = count > id ? count : id + 1;
+	struct counters *counters = realloc(self->counters, size * sizeof(*counters));
+	if (!counters)
+		abort();
+	memset(counters + self->size, 0, (size - self->size) * sizeof(*counters));
+	self->counters = counters;
+	self->size = size;
+	pthread_mutex_unlock(&lock);
+	return self;
+}
+
+void __1337_profile_enter(struct __1337_profile_frame *frame, uint64_t id)
+{
+	struct thread_profile *profile = self;
+	if (__builtin_expect(!profile || id >= profile->size, 0))
+		profile = grow(id);
+
+	struct counters *counters = &profile->counters[id];
+	++counters->calls;
+	++counters->active;
+	frame->id = id;
+	frame->children = 0;
+	frame->parent = current;
+	current = frame;
+	frame->start = ticks();
+}
+
+void __1337_profile_exit(struct __1337_profile_frame *frame)
+{
+	uint64_t elapsed = ticks() - frame->start;
+	struct counters *counters = &self->counters[frame->id];
+	counters->exclusive += elapsed - frame->children;
+	if (--counters->active == 0)
+		counters->inclusive += elapsed;
+	if (frame->parent)
+		frame->parent->children += elapsed;
+	current = frame->parent;
+}
@@ -0,0 +1,32 @@
+#ifndef _1337_PROFILE_H_
+#define _1337_PROFILE_H_
+
+#include <stdint.h>
+
+/*
+ * Flat profiler behind `-finstrument`.
+ *
+ * Every instrumented function keeps a frame on its stack and calls
+ * `__1337_profile_enter` on entry and `__1337_profile_exit` before each
+ * return. Frames are linked through a thread local pointer, so a callee adds
+ * its inclusive time to the caller's `children` and the caller's exclusive
+ * time is what is left. Counters are per thread, the hot path takes no lock
+ * and does no atomic operation.
+ *
+ * Each module registers the names of its functions from a constructor and
+ * gets the first id of its range back in `*base`. At exit the counters of all
+ * threads are summed up and a flat profile, sorted by exclusive time, goes to
+ * stderr.
+ */
+struct __1337_profile_frame {
+	uint64_t start; // Ticks when the function was entered
+	uint64_t children; // Ticks spent in instrumented callees
+	uint64_t id;
+	struct __1337_profile_frame *parent;
+};
+
+void __1337_profile_register(const char *const *names, uint64_t count, uint64_t *base);
+void __1337_profile_enter(struct __1337_profile_frame *frame, uint64_t id);
+void __1337_profile_exit(struct __1337_profile_frame *frame);
+
+#endif
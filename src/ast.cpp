@@ -3,15 +3,25 @@
 
 int BinaryOpExprAst::get_precedence(std::string op)
 {
-	static std::unordered_map<std::string, int> precedence {
+	static const std::unordered_map<std::string, int> precedence {
+		{ "==", 10 },
+		{ "!=", 10 },
+		{ "<", 10 },
+		{ ">", 10 },
+		{ "<=", 10 },
+		{ ">=", 10 },
 		{ "+", 20 },
 		{ "-", 20 },
+		{ "+%", 20 },
+		{ "-%", 20 },
 		{ "*", 40 },
 		{ "/", 40 },
+		{ "*%", 40 },
 	};
 
-	if (precedence.find(op) == precedence.end())
+	auto found = precedence.find(op);
+	if (found == precedence.end())
 		return -1;
 
-	return precedence[op];
+	return found->second;
 }
@@ -119,16 +119,55 @@ public:
 	}
 };
 
+class PointerTypeExprAst : public ExprAst {
+public:
+	std::unique_ptr<TypeExprAst> pointee;
+public:
+	inline PointerTypeExprAst(SourceLocation loc, std::unique_ptr<TypeExprAst> pointee)
+		: ExprAst(loc), pointee(std::move(pointee))
+	{}
+
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "PointerTypeExprAst (" << this->loc.str() << ") { pointee: " << this->pointee->to_string() << " }";
+		return ss.str();
+	}
+};
+
+class GenericTypeExprAst : public ExprAst {
+public:
+	std::string name;
+	std::vector<std::unique_ptr<TypeExprAst>> args;
+public:
+	inline GenericTypeExprAst(SourceLocation loc, std::string name, std::vector<std::unique_ptr<TypeExprAst>> args)
+		: ExprAst(loc), name(name), args(std::move(args))
+	{}
+
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "GenericTypeExprAst (" << this->loc.str() << ") { name: " << this->name << ", args: [";
+		for (auto &arg : this->args) {
+			ss << arg->to_string() << " ";
+		}
+		ss << "] }";
+		return ss.str();
+	}
+};
+
 class FunctionParamAst {
 public:
 	SourceLocation loc;
 	std::unique_ptr<VariableExprAst> var;
 	std::unique_ptr<TypeExprAst> type;
+	bool mut; // Can be assigned to, and pointers can be written through
 public:
 	inline FunctionParamAst(SourceLocation loc,
 	                        std::unique_ptr<VariableExprAst> var,
-	                        std::unique_ptr<TypeExprAst> type)
-		: loc(loc), var(std::move(var)), type(std::move(type))
+	                        std::unique_ptr<TypeExprAst> type,
+	                        bool mut = false)
+		: loc(loc), var(std::move(var)), type(std::move(type)), mut(mut)
 	{}
 
 	inline std::string to_string()
@@ -136,27 +175,79 @@ public:
 		std::stringstream ss;
 
 		ss << "FunctionParamAst (" << this->loc.str() << ") { var: " << this->var->to_string() <<
-			", type: " << this->type->to_string() << " }";
+			", type: " << this->type->to_string() << ", mut: " << (this->mut ? "true" : "false") << " }";
 
 		return ss.str();
 	}
 };
 
+class StructFieldAst {
+public:
+	SourceLocation loc;
+	std::string name;
+	std::unique_ptr<TypeExprAst> type;
+	unsigned int align = 0; // `@align(N)`, starts at a multiple of N and shares those N bytes with no other field
+	bool cold = false; // `@cold`, moved out of line so the other fields pack tighter
+public:
+	inline StructFieldAst(SourceLocation loc, std::string name, std::unique_ptr<TypeExprAst> type)
+		: loc(loc), name(name), type(std::move(type))
+	{}
+
+	inline std::string to_string()
+	{
+		std::stringstream ss;
+
+		ss << "StructFieldAst (" << this->loc.str() << ") { name: " << this->name <<
+			", type: " << this->type->to_string() << ", align: " << this->align <<
+			", cold: " << (this->cold ? "true" : "false") << " }";
+
+		return ss.str();
+	}
+};
+
+// Token Patterns: [Struct] ([At] [Identifier])* [LeftCurly] (<Field> [Comma]?)* [RightCurly]
+class StructTypeExprAst : public ExprAst {
+public:
+	std::vector<std::unique_ptr<StructFieldAst>> fields;
+	bool packed = false; // `@packed`, declaration order without any padding
+public:
+	inline StructTypeExprAst(SourceLocation loc, std::vector<std::unique_ptr<StructFieldAst>> fields)
+		: ExprAst(loc), fields(std::move(fields))
+	{}
+
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "StructTypeExprAst (" << this->loc.str() << ") { fields: [";
+		for (auto &field : this->fields) {
+			ss << field->to_string() << " ";
+		}
+		ss << "], packed: " << (this->packed ? "true" : "false") << " }";
+		return ss.str();
+	}
+};
+
 class FunctionProtoExprAst : public ExprAst {
 public:
 	std::vector<std::unique_ptr<FunctionParamAst>> params;
 	std::unique_ptr<TypeExprAst> return_type; // `nullptr` means no return
+	std::vector<std::string> type_params; // Generic functions get an instance for every distinct list of type arguments
 public:
 	inline FunctionProtoExprAst(SourceLocation loc,
 	                            std::vector<std::unique_ptr<FunctionParamAst>> params,
-	                            std::unique_ptr<TypeExprAst> return_type)
-		: ExprAst(loc), params(std::move(params)), return_type(std::move(return_type))
+	                            std::unique_ptr<TypeExprAst> return_type,
+	                            std::vector<std::string> type_params = {})
+		: ExprAst(loc), params(std::move(params)), return_type(std::move(return_type)), type_params(type_params)
 	{}
 
 	virtual inline std::string to_string() override
 	{
 		std::stringstream ss;
-		ss << "FunctionProtoExprAst (" << this->loc.str() << ") { params: [";
+		ss << "FunctionProtoExprAst (" << this->loc.str() << ") { type_params: [";
+		for (auto &type_param : this->type_params) {
+			ss << type_param << " ";
+		}
+		ss << "], params: [";
 		for (auto &param : this->params) {
 			ss << param->to_string() << " ";
 		}
@@ -212,6 +303,8 @@ public:
 	std::unique_ptr<VariableExprAst> name;
 	std::unique_ptr<TypeExprAst> explicit_type; // Can be null (type should be infered)
 	std::unique_ptr<ExprAst> value; // Can be null (should be zeroed)
+	bool exported = false; // Declared `pub`, visible outside of the module
+	bool mut = false; // Declared `mut`, bindings are immutable by default
 public:
 	inline DeclarationExprAst(SourceLocation loc,
 	                          std::unique_ptr<VariableExprAst> name,
@@ -226,7 +319,46 @@ public:
 		ss << "DeclarationExprAst (" << this->loc.str() << ") { name: " <<
 			this->name->to_string() << ", explicit_type: " <<
 			(this->explicit_type ? this->explicit_type->to_string() : "None") << ", value: " <<
-			(this->value ? this->value->to_string() : "None");
+			(this->value ? this->value->to_string() : "None") << ", exported: " <<
+			(this->exported ? "true" : "false") << ", mut: " << (this->mut ? "true" : "false");
+		return ss.str();
+	}
+};
+
+// Token Patterns: [Identifier] [Equals] <Expr>, only for `mut` bindings
+//                 <Member> [Equals] <Expr>
+class AssignExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> target; // A `VariableExprAst` or a `MemberExprAst`
+	std::unique_ptr<ExprAst> value;
+public:
+	inline AssignExprAst(SourceLocation loc, std::unique_ptr<ExprAst> target, std::unique_ptr<ExprAst> value)
+		: ExprAst(loc), target(std::move(target)), value(std::move(value))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "AssignExprAst (" << this->loc.str() << ") { target: " << this->target->to_string() <<
+			", value: " << this->value->to_string() << " }";
+		return ss.str();
+	}
+};
+
+// Token Patterns: <Expr> [Dot] [Identifier]
+// Pointers to structs are dereferenced implicitly
+class MemberExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> object;
+	std::string field;
+public:
+	inline MemberExprAst(SourceLocation loc, std::unique_ptr<ExprAst> object, std::string field)
+		: ExprAst(loc), object(std::move(object)), field(field)
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "MemberExprAst (" << this->loc.str() << ") { object: " << this->object->to_string() <<
+			", field: " << this->field << " }";
 		return ss.str();
 	}
 };
@@ -260,18 +392,24 @@ public:
 class CallExprAst : public ExprAst {
 public:
 	std::string function;
+	std::vector<std::unique_ptr<TypeExprAst>> type_args; // Explicit type arguments, as in `alloc<i32>()`
 	std::vector<std::unique_ptr<ExprAst>> args;
 public:
 	inline CallExprAst(SourceLocation loc,
 	                   std::string function,
+	                   std::vector<std::unique_ptr<TypeExprAst>> type_args,
 	                   std::vector<std::unique_ptr<ExprAst>> args)
-		: ExprAst(loc), function(function), args(std::move(args))
+		: ExprAst(loc), function(function), type_args(std::move(type_args)), args(std::move(args))
 	{}
 
 	virtual inline std::string to_string() override {
 		std::stringstream ss;
 
-		ss << "CallExprAst (" << this->loc.str() << ") { function: " << this->function << ", args: [";
+		ss << "CallExprAst (" << this->loc.str() << ") { function: " << this->function << ", type_args: [";
+		for (auto &type_arg : this->type_args) {
+			ss << type_arg->to_string() << " ";
+		}
+		ss << "], args: [";
 		for (auto &arg : this->args) {
 			ss << arg->to_string();
 		}
@@ -299,6 +437,110 @@ public:
 	}
 };
 
+// Every allocation in the body comes from the arena `name`, and is released all at once when the body ends
+class ArenaExprAst : public ExprAst {
+public:
+	std::unique_ptr<VariableExprAst> name;
+	std::unique_ptr<CodeblockExprAst> body;
+public:
+	inline ArenaExprAst(SourceLocation loc, std::unique_ptr<VariableExprAst> name, std::unique_ptr<CodeblockExprAst> body)
+		: ExprAst(loc), name(std::move(name)), body(std::move(body))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "ArenaExprAst (" << this->loc.str() << ") { name: " <<
+			this->name->to_string() << ", body: " << this->body->to_string() << " }";
+		return ss.str();
+	}
+};
+
+// The expression runs whenever the enclosing block is left, in reverse order of the defers
+class DeferExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> expr;
+public:
+	inline DeferExprAst(SourceLocation loc, std::unique_ptr<ExprAst> expr)
+		: ExprAst(loc), expr(std::move(expr))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "DeferExprAst (" << this->loc.str() << ") { expr: " << this->expr->to_string() << " }";
+		return ss.str();
+	}
+};
+
+// Evaluated by the compiler, the program only sees the resulting constant
+class ComptimeExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> expr;
+public:
+	inline ComptimeExprAst(SourceLocation loc, std::unique_ptr<ExprAst> expr)
+		: ExprAst(loc), expr(std::move(expr))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "ComptimeExprAst (" << this->loc.str() << ") { expr: " << this->expr->to_string() << " }";
+		return ss.str();
+	}
+};
+
+class ReturnExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> value; // `nullptr` means no return value
+public:
+	inline ReturnExprAst(SourceLocation loc, std::unique_ptr<ExprAst> value)
+		: ExprAst(loc), value(std::move(value))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "ReturnExprAst (" << this->loc.str() << ") { value: " <<
+			(this->value ? this->value->to_string() : "None") << " }";
+		return ss.str();
+	}
+};
+
+class IfExprAst : public ExprAst {
+public:
+	std::unique_ptr<ExprAst> condition;
+	std::unique_ptr<CodeblockExprAst> then_body;
+	std::unique_ptr<ExprAst> else_body; // Either a `CodeblockExprAst` or another `IfExprAst`, can be null
+public:
+	inline IfExprAst(SourceLocation loc,
+	                 std::unique_ptr<ExprAst> condition,
+	                 std::unique_ptr<CodeblockExprAst> then_body,
+	                 std::unique_ptr<ExprAst> else_body)
+		: ExprAst(loc), condition(std::move(condition)), then_body(std::move(then_body)), else_body(std::move(else_body))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "IfExprAst (" << this->loc.str() << ") { condition: " << this->condition->to_string() <<
+			", then_body: " << this->then_body->to_string() << ", else_body: " <<
+			(this->else_body ? this->else_body->to_string() : "None") << " }";
+		return ss.str();
+	}
+};
+
+// Guaranteed tail call: the current function's frame is replaced by the callee's
+class BecomeExprAst : public ExprAst {
+public:
+	std::unique_ptr<CallExprAst> call;
+public:
+	inline BecomeExprAst(SourceLocation loc, std::unique_ptr<CallExprAst> call)
+		: ExprAst(loc), call(std::move(call))
+	{}
+	virtual inline std::string to_string() override
+	{
+		std::stringstream ss;
+		ss << "BecomeExprAst (" << this->loc.str() << ") { call: " << this->call->to_string() << " }";
+		return ss.str();
+	}
+};
+
 class ArrayIndexExprAst : public ExprAst {
 public:
 	std::unique_ptr<VariableExprAst> var;
@@ -0,0 +1,254 @@
+#include "attributes.hpp"
+#include <tuple>
+#include <vector>
+
+Effects Effects::of(llvm::CallBase *call)
+{
+	Effects effects;
+	effects.reads = !call->doesNotAccessMemory();
+	effects.writes = !call->onlyReadsMemory();
+	effects.unwinds = !call->doesNotThrow();
+	effects.frees = !call->hasFnAttr(llvm::Attribute::NoFree);
+	effects.syncs = !call->hasFnAttr(llvm::Attribute::NoSync);
+	effects.returns = call->hasFnAttr(llvm::Attribute::WillReturn);
+
+	return effects;
+}
+
+Effects Effects::of(llvm::Function *function)
+{
+	Effects effects;
+	effects.reads = !function->doesNotAccessMemory();
+	effects.writes = !function->onlyReadsMemory();
+	effects.unwinds = !function->doesNotThrow();
+	effects.frees = !function->hasFnAttribute(llvm::Attribute::NoFree);
+	effects.syncs = !function->hasFnAttribute(llvm::Attribute::NoSync);
+	effects.returns = function->hasFnAttribute(llvm::Attribute::WillReturn);
+
+	return effects;
+}
+
+bool Effects::operator==(const Effects &other) const
+{
+	return std::tie(this->reads, this->writes, this->unwinds, this->frees, this->syncs, this->returns) ==
+		std::tie(other.reads, other.writes, other.unwinds, other.frees, other.syncs, other.returns);
+}
+
+// The function's own stack isn't visible to its callers
+static bool is_local(llvm::Value *ptr)
+{
+	return llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(ptr));
+}
+
+// Reading constants is as good as not reading memory at all, they never change
+static bool is_constant(llvm::Value *ptr)
+{
+	auto global = llvm::dyn_cast<llvm::GlobalVariable>(llvm::getUnderlyingObject(ptr));
+	return global && global->isConstant();
+}
+
+Effects AttributeInferencePass::infer(llvm::Function &function)
+{
+	Effects result;
+	result.returns = true;
+
+	// Loops may run forever
+	llvm::SmallVector<std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>> backedges;
+	llvm::FindFunctionBackedges(function, backedges);
+	if (!backedges.empty())
+		result.returns = false;
+
+	for (auto &block : function) {
+		for (auto &inst : block) {
+			if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst); load != nullptr) {
+				result.reads |= !is_local(load->getPointerOperand()) && !is_constant(load->getPointerOperand());
+				result.syncs |= !load->isUnordered();
+			} else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst); store != nullptr) {
+				result.writes |= !is_local(store->getPointerOperand());
+				result.syncs |= !store->isUnordered();
+			} else if (auto call = llvm::dyn_cast<llvm::CallBase>(&inst); call != nullptr) {
+				// Calls to functions of the module use what we know about them so far
+				auto callee = call->getCalledFunction();
+				auto known = callee ? this->effects.find(callee) : this->effects.end();
+				auto effects = known != this->effects.end() ? known->second : Effects::of(call);
+
+				// Intrinsics like `memset` on our own stack
+				if (call->onlyAccessesArgMemory() && llvm::all_of(call->args(), [](llvm::Value *arg) {
+					return !arg->getType()->isPointerTy() || is_local(arg);
+				})) {
+					effects.reads = false;
+					effects.writes = false;
+				}
+
+				result.reads |= effects.reads;
+				result.writes |= effects.writes;
+				result.unwinds |= effects.unwinds;
+				result.frees |= effects.frees;
+				result.syncs |= effects.syncs;
+				result.returns &= effects.returns;
+			} else if (inst.isAtomic() || llvm::isa<llvm::FenceInst>(&inst)) {
+				result.reads |= inst.mayReadFromMemory();
+				result.writes |= inst.mayWriteToMemory();
+				result.syncs = true;
+			} else {
+				result.reads |= inst.mayReadFromMemory();
+				result.writes |= inst.mayWriteToMemory();
+				result.unwinds |= inst.mayThrow();
+			}
+		}
+	}
+
+	return result;
+}
+
+bool AttributeInferencePass::apply(llvm::Function &function, const Effects &effects)
+{
+	auto before = Effects::of(&function);
+
+	if (!effects.reads && !effects.writes)
+		function.setDoesNotAccessMemory();
+	else if (!effects.writes)
+		function.setOnlyReadsMemory();
+	if (!effects.unwinds)
+		function.setDoesNotThrow();
+	if (!effects.frees)
+		function.addFnAttr(llvm::Attribute::NoFree);
+	if (!effects.syncs)
+		function.addFnAttr(llvm::Attribute::NoSync);
+	if (effects.returns)
+		function.addFnAttr(llvm::Attribute::WillReturn);
+
+	// Immutable pointer parameters are `noalias` on the assumption that nothing writes
+	// memory during the call, which only holds if the function doesn't
+	bool dropped = false;
+	for (auto &arg : function.args()) {
+		if (effects.writes && arg.hasAttribute(llvm::Attribute::ReadOnly) && arg.hasNoAliasAttr()) {
+			arg.removeAttr(llvm::Attribute::NoAlias);
+			dropped = true;
+		}
+	}
+
+	return dropped || !(Effects::of(&function) == before);
+}
+
+// An identical earlier call to a `memory(none)` function in the same block already has the result
+size_t AttributeInferencePass::remove_redundant_calls(llvm::Function &function)
+{
+	size_t removed = 0;
+
+	for (auto &block : function) {
+		std::map<std::pair<llvm::Value *, std::vector<llvm::Value *>>, llvm::CallBase *> seen;
+		for (auto &inst : llvm::make_early_inc_range(block)) {
+			auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+			if (!call || !call->doesNotAccessMemory() || call->getType()->isVoidTy() || call->isMustTailCall())
+				continue;
+
+			auto key = std::make_pair(call->getCalledOperand(), std::vector<llvm::Value *>(call->arg_begin(), call->arg_end()));
+			auto prev = seen.find(key);
+			if (prev == seen.end()) {
+				seen[key] = call;
+				continue;
+			}
+
+			call->replaceAllUsesWith(prev->second);
+			call->eraseFromParent();
+			++removed;
+		}
+	}
+
+	return removed;
+}
+
+// Calls without side effects whose result is unused, and whatever only fed them
+size_t AttributeInferencePass::remove_dead_calls(llvm::Function &function)
+{
+	llvm::SmallVector<llvm::WeakTrackingVH> dead;
+	for (auto &block : function) {
+		for (auto &inst : block) {
+			if (llvm::isa<llvm::CallBase>(&inst) && llvm::isInstructionTriviallyDead(&inst))
+				dead.push_back(&inst);
+		}
+	}
+
+	auto removed = dead.size();
+	llvm::RecursivelyDeleteTriviallyDeadInstructions(dead);
+
+	return removed;
+}
+
+llvm::PreservedAnalyses AttributeInferencePass::run(llvm::Module &module, llvm::ModuleAnalysisManager &mam)
+{
+	std::vector<llvm::Function *> functions;
+	for (auto &function : module) {
+		// Only a body that is the one that runs tells what calls do. A `linkonce_odr` one (the
+		// rc runtime, `pub` generic instances) may be replaced by another module's copy, which
+		// can have other effects once it was optimized differently.
+		if (!function.hasExactDefinition())
+			continue;
+
+		functions.push_back(&function);
+	}
+
+	// Every effect starts out absent and only gets added, so this terminates
+	this->effects.clear();
+	for (auto function : functions)
+		this->effects[function] = Effects {};
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto function : functions) {
+			auto inferred = this->infer(*function);
+			if (!(inferred == this->effects[function])) {
+				this->effects[function] = inferred;
+				changed = true;
+			}
+		}
+	}
+
+	bool modified = false;
+	for (auto function : functions) {
+		auto &effects = this->effects[function];
+		if (!this->apply(*function, effects))
+			continue;
+
+		modified = true;
+		llvm::OptimizationRemarkEmitter remarks(function);
+		remarks.emit([&]() {
+			auto remark = llvm::OptimizationRemark("attributes", "Inferred", function);
+			remark << "'" << function->getName() << "' is";
+			if (!effects.reads && !effects.writes)
+				remark << " memory(none)";
+			else if (!effects.writes)
+				remark << " memory(read)";
+			if (!effects.unwinds)
+				remark << " nounwind";
+			if (!effects.frees)
+				remark << " nofree";
+			if (!effects.syncs)
+				remark << " nosync";
+			if (effects.returns)
+				remark << " willreturn";
+			return remark;
+		});
+	}
+
+	if (this->simplify) {
+		for (auto function : functions) {
+			auto redundant = this->remove_redundant_calls(*function);
+			auto dead = this->remove_dead_calls(*function);
+			if (redundant + dead == 0)
+				continue;
+
+			modified = true;
+			llvm::OptimizationRemarkEmitter remarks(function);
+			remarks.emit([&]() {
+				return llvm::OptimizationRemark("attributes", "CallsRemoved", function)
+					<< "removed " << llvm::ore::NV("Redundant", redundant) << " redundant and "
+					<< llvm::ore::NV("Dead", dead) << " dead calls in '" << function->getName() << "'";
+			});
+		}
+	}
+
+	return modified ? llvm::PreservedAnalyses::none() : llvm::PreservedAnalyses::all();
+}
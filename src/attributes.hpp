@@ -0,0 +1,55 @@
+#ifndef _ATTRIBUTES_HPP_
+#define _ATTRIBUTES_HPP_
+
+#include "llvm.hpp"
+#include <map>
+
+// What a function may do when it is called, as far as its callers are concerned
+struct Effects {
+	bool reads = false; // Reads memory that isn't its own stack
+	bool writes = false; // Writes memory that isn't its own stack
+	bool unwinds = false;
+	bool frees = false;
+	bool syncs = false; // Atomics or other synchronization with other threads
+	bool returns = false; // Always returns, it can't loop or recurse forever
+
+	static Effects of(llvm::CallBase *call);
+	static Effects of(llvm::Function *function);
+	bool operator==(const Effects &other) const;
+};
+
+/*
+ * Infers `memory(none)`/`memory(read)`, `nounwind`, `nofree`, `nosync` and `willreturn`
+ * for the functions defined in the module, so calls to them stop being optimization
+ * barriers.
+ *
+ * The call graph is solved as a whole: the memory, unwinding, freeing and synchronization
+ * effects start out optimistic (recursion on its own doesn't do anything) and grow until
+ * nothing changes. Returning starts out pessimistic instead, a function only returns if
+ * it has no loops and everything it calls returns, so any recursion keeps it unknown.
+ * Declarations are taken at their word, `InferFunctionAttrsPass` knows the C library.
+ *
+ * With `simplify`, calls that the attributes prove redundant (an identical earlier call to
+ * a `memory(none)` function in the same block) or dead (unused result, no side effects)
+ * are removed right away. LICM and GVN pick up the rest in the `-O` pipeline.
+ *
+ * Reports under `-Rpass=attributes`.
+ */
+class AttributeInferencePass : public llvm::PassInfoMixin<AttributeInferencePass> {
+private:
+	bool simplify;
+	std::map<llvm::Function *, Effects> effects;
+public:
+	inline AttributeInferencePass(bool simplify = false)
+		: simplify(simplify)
+	{}
+
+	llvm::PreservedAnalyses run(llvm::Module &module, llvm::ModuleAnalysisManager &mam);
+private:
+	Effects infer(llvm::Function &function);
+	bool apply(llvm::Function &function, const Effects &effects);
+	size_t remove_redundant_calls(llvm::Function &function);
+	size_t remove_dead_calls(llvm::Function &function);
+};
+
+#endif
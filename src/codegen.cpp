@@ -6,6 +6,13 @@ bool Codegen::include(DeclarationExprAst *expr)
 {
 	auto builder = &this->builder;
 
+	if (auto type = dynamic_cast<StructTypeExprAst *>(expr->value.get()); type != nullptr)
+		return !builder->GetInsertBlock() && (this->structs.count(expr->name->name) > 0 || this->define_struct(expr, type));
+
+	// Declarations inside of a function body live on the stack
+	if (builder->GetInsertBlock() != nullptr && dynamic_cast<FunctionExprAst *>(expr->value.get()) == nullptr)
+		return this->include_local(expr);
+
 	if (auto number = dynamic_cast<NumberExprAst *>(expr->value.get()); number != nullptr) {
 		llvm::Type *type;
 		if (expr->explicit_type != nullptr)
@@ -13,197 +20,2374 @@ bool Codegen::include(DeclarationExprAst *expr)
 		else
 			type = builder->getDoubleTy(); // TODO: Type inference
 
-		llvm::Constant *value;
-		if (type->isIntegerTy()) {
-			value = llvm::Constant::getIntegerValue(type, llvm::APInt(type->getIntegerBitWidth(), number->number, 10));
-		} else {
-			value = llvm::ConstantFP::get(type, number->number);
+		auto value = this->number(number, type);
+		auto var = new llvm::GlobalVariable(module, type, !expr->mut, this->linkage(expr), value, expr->name->name);
+		if (!expr->mut && var->hasLocalLinkage())
+			var->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+		this->variables[expr->name->name] = Variable { type, var, RcKind::None, false, expr->mut };
+		if (!expr->mut)
+			this->comptime.globals[expr->name->name] = value;
+		return true;
+	} else if (auto comptime = dynamic_cast<ComptimeExprAst *>(expr->value.get()); comptime != nullptr) {
+		// The data layout decides the sizes the memory limit counts
+		this->target();
+
+		// A table is declared as an array of its elements
+		auto explicit_type = expr->explicit_type ? expr->explicit_type.get() : nullptr;
+		auto array = explicit_type ? dynamic_cast<ArrayTypeExprAst *>(explicit_type->type.get()) : nullptr;
+		llvm::Type *type = nullptr;
+		if (explicit_type && !(type = this->type(array ? array->recursing_type.get() : explicit_type)))
+			return false;
+
+		auto value = this->comptime.run(comptime->expr.get(), type);
+		if (!value) {
+			std::cout << "[ERR] " << this->comptime.error << std::endl;
+			return false;
 		}
-		auto var = new llvm::GlobalVariable(module, type, false, llvm::GlobalValue::ExternalLinkage, value, expr->name->name);
-		this->variables[expr->name->name] = std::make_pair<>(type, var);
+		if (explicit_type && (array != nullptr) != value->getType()->isArrayTy())
+			return false;
+
+		type = value->getType();
+		auto var = new llvm::GlobalVariable(module, type, !expr->mut, this->linkage(expr), value, expr->name->name);
+		if (!expr->mut && var->hasLocalLinkage())
+			var->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+		this->variables[expr->name->name] = Variable { type, var, RcKind::None, false, expr->mut };
+		if (!expr->mut)
+			this->comptime.globals[expr->name->name] = value;
 		return true;
 	} else if (auto str = dynamic_cast<StringExprAst *>(expr->value.get()); str != nullptr) {
-		auto value = builder->CreateGlobalStringPtr(str->value);
-		auto var = new llvm::GlobalVariable(module, builder->getPtrTy(), false, llvm::GlobalValue::ExternalLinkage, value, expr->name->name);
-		this->variables[expr->name->name] = std::make_pair<>(var->getType(), var);
+		auto value = builder->CreateGlobalStringPtr(str->value, "", 0, &this->module);
+		auto var = new llvm::GlobalVariable(module, builder->getPtrTy(), !expr->mut, this->linkage(expr), value, expr->name->name);
+		if (!expr->mut && var->hasLocalLinkage())
+			var->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+		this->variables[expr->name->name] = Variable { var->getType(), var, RcKind::None, false, expr->mut };
 		return true;
 	} else if (auto func = dynamic_cast<FunctionExprAst *>(expr->value.get()); func != nullptr) {
-		auto ret_type = builder->getVoidTy();
-		std::vector<llvm::Type *> param_types = {};
-		for (auto &param : func->proto->params) {
-			auto type = this->type(param->type.get());
-			if (!type)
-				return false;
-
-			param_types.push_back(type);
+		// Generic functions are generated by their instantiations
+		if (this->is_generic(expr)) {
+			this->generics[expr->name->name] = expr;
+			return true;
 		}
 
-		auto name = expr->name->name;
-		auto type = llvm::FunctionType::get(ret_type, param_types, false);
-		auto function = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, this->module);
-		auto block = llvm::BasicBlock::Create(this->context, "entry", function);
-		builder->SetInsertPoint(block);
+		// The prototype may already exist from `predeclare`, but there is only one body
+		auto function = this->prototype(expr, func->proto.get(), expr->name->name);
+		if (!function || !function->isDeclaration() || !this->define(function, func))
+			return false;
 
-		for (auto &arg : function->args()) {
-			auto i = arg.getArgNo();
-			auto type = param_types[i];
-			auto name = func->proto->params[i]->var->name;
-			auto local_var = builder->CreateAlloca(type, nullptr, name);
-			llvm::Value *val = &arg;
-			builder->CreateStore(val, local_var);
-			this->variables[name] = std::make_pair<>(type, local_var);
-		}
+		this->variables[expr->name->name] = Variable { function->getFunctionType(), function };
+		return true;
+	}
 
-		for (auto &subexpr : func->body->subexprs) {
-			if (!this->include(subexpr.get()))
-				return false;
-		}
+	return false;
+}
+
+// Generates the body of `function`
+bool Codegen::define(llvm::Function *function, FunctionExprAst *func)
+{
+	auto builder = &this->builder;
+	auto type = function->getFunctionType();
+	auto ret_type = type->getReturnType();
+	auto &param_rcs = this->rc_params[function];
+	auto &params = func->proto->params;
+	auto block = llvm::BasicBlock::Create(this->context, "entry", function);
+	builder->SetInsertPoint(block);
+
+	// The prologue and epilogue are attributed to the `fn`, the statements to their own lines.
+	// An instance is generated in the middle of its caller, which goes on with its own location.
+	auto outer_location = builder->getCurrentDebugLocation();
+	llvm::DISubprogram *subprogram = nullptr;
+	if (this->debug_info) {
+		subprogram = this->debug_info->function(function, func->source_loc());
+		builder->SetCurrentDebugLocation(this->debug_info->location(func->source_loc(), subprogram));
+	}
+	this->return_slot = ret_type->isVoidTy() ? nullptr : builder->CreateAlloca(ret_type, nullptr, "retval");
+
+	this->push_scope();
+	for (auto &arg : function->args()) {
+		auto i = arg.getArgNo();
+		auto type = arg.getType();
+		auto name = params[i]->var->name;
+		auto local_var = builder->CreateAlloca(type, nullptr, name);
+		local_var->setAlignment(llvm::Align(this->align_of(type)));
+		llvm::Value *val = &arg;
+		builder->CreateStore(val, local_var);
+		if (subprogram)
+			this->debug_info->variable(local_var, name, i + 1, params[i]->loc, subprogram, builder->GetInsertBlock());
+		this->declare(name, Variable { type, local_var, param_rcs[i], false, params[i]->mut, arg.hasAttribute(llvm::Attribute::ReadOnly),
+		                               this->pointee(params[i]->type.get()), this->elements(params[i]->type.get()) });
+	}
 
-		builder->CreateRetVoid();
+	llvm::Value *value = nullptr;
+	bool ok = this->include_statements(func->body->subexprs, ret_type->isVoidTy() ? nullptr : &value);
+
+	// Falling off the end returns the trailing expression
+	if (ok && !this->is_terminated()) {
+		if (value && !value->getType()->isVoidTy())
+			value = this->convert(this->owned(func->body->subexprs.back().get(), value), ret_type);
+		else
+			value = nullptr;
+
+		ok = (ret_type->isVoidTy() || value != nullptr) && this->exit_scopes(this->scopes.size(), 0, nullptr, value);
+	}
+
+	if (!ok) {
+		this->scopes.clear();
+		this->return_slot = nullptr;
 		builder->ClearInsertionPoint();
-		this->variables[expr->name->name] = std::make_pair<>(type, function);
+		builder->SetCurrentDebugLocation(outer_location);
+		return false;
+	}
+
+	this->pop_scope();
+	this->return_slot = nullptr;
+	builder->ClearInsertionPoint();
+	builder->SetCurrentDebugLocation(outer_location);
+	if (this->options.instrument)
+		this->instrumented.push_back(function);
+	return true;
+}
+
+// Creates the prototypes of top level functions up front, so they can be called before their definition.
+// Struct types are laid out here as well, they have to be declared before they are used by value.
+bool Codegen::predeclare(ExprAst *expr)
+{
+	if (auto ext = dynamic_cast<ExternExprAst *>(expr); ext != nullptr)
+		return this->include(ext);
+
+	auto decl = dynamic_cast<DeclarationExprAst *>(expr);
+	if (!decl)
+		return true;
+
+	if (auto type = dynamic_cast<StructTypeExprAst *>(decl->value.get()); type != nullptr)
+		return this->define_struct(decl, type);
+
+	auto func = dynamic_cast<FunctionExprAst *>(decl->value.get());
+	if (!func)
+		return true;
+
+	if (this->is_generic(decl)) {
+		this->generics[decl->name->name] = decl;
 		return true;
 	}
 
-	return false;
+	this->comptime.functions[decl->name->name] = func;
+	return this->prototype(decl, func->proto.get(), decl->name->name) != nullptr;
 }
 
-bool Codegen::include(CallExprAst *expr)
+// Token Patterns: [Extern] [Mut]? [Identifier] <Declaration>
+// A function or global defined by another file (as `pub`) or a library. Declaring it twice is
+// fine, `predeclare` already did for the calls before it.
+bool Codegen::include(ExternExprAst *expr)
 {
-	auto function = this->module.getFunction(expr->function);
+	auto decl = expr->decl.get();
+	auto &name = decl->name->name;
+	if (this->builder.GetInsertBlock())
+		return false;
 
-	std::vector<llvm::Value *> args;
-	for (auto &arg : expr->args) {
-		args.push_back(this->eval(arg.get()));
+	// Both `extern f: fn ...` and `extern f := fn ...`
+	auto proto = dynamic_cast<FunctionProtoExprAst *>(decl->value.get());
+	if (!proto && !decl->value && decl->explicit_type)
+		proto = dynamic_cast<FunctionProtoExprAst *>(decl->explicit_type->type.get());
+	if (proto) {
+		if (!proto->type_params.empty())
+			return false;
+
+		auto function = this->prototype(decl, proto, name);
+		if (!function)
+			return false;
+
+		this->variables[name] = Variable { function->getFunctionType(), function };
+		return true;
 	}
-	this->builder.CreateCall(function, args);
 
+	// Globals only have a type here, their value lives with their definition
+	if (decl->value || !decl->explicit_type)
+		return false;
+
+	auto type = this->type(decl->explicit_type.get());
+	if (!type || this->is_split(type))
+		return false;
+
+	auto var = this->module.getNamedGlobal(name);
+	if (!var)
+		var = new llvm::GlobalVariable(this->module, type, !decl->mut, llvm::GlobalValue::ExternalLinkage, nullptr, name);
+	else if (var->getValueType() != type)
+		return false;
+
+	this->variables[name] = Variable { type, var, RcKind::None, false, decl->mut, false, this->pointee(decl->explicit_type.get()) };
 	return true;
 }
 
-llvm::Value *Codegen::eval(StringExprAst *str)
+bool Codegen::is_generic(DeclarationExprAst *expr)
 {
-	auto value = this->builder.CreateGlobalStringPtr(str->value, "", 0, &this->module);
-	return value;
+	auto func = dynamic_cast<FunctionExprAst *>(expr->value.get());
+	return func && !func->proto->type_params.empty();
 }
 
-llvm::Value *Codegen::eval(VariableExprAst *expr)
+// Only `pub` symbols and the entry point are visible outside of the module. Everything else
+// is internal, so the optimizer sees all of its uses and may inline, specialize or drop it.
+// Every module using a `pub` generic function generates the same instances, the linker keeps one.
+llvm::GlobalValue::LinkageTypes Codegen::linkage(DeclarationExprAst *expr)
 {
-	if (this->variables.find(expr->name) == this->variables.end())
+	if (expr->exported && this->is_generic(expr))
+		return llvm::GlobalValue::LinkOnceODRLinkage;
+	if (expr->exported || expr->name->name == "main")
+		return llvm::GlobalValue::ExternalLinkage;
+
+	return llvm::GlobalValue::InternalLinkage;
+}
+
+llvm::Function *Codegen::prototype(DeclarationExprAst *expr, FunctionProtoExprAst *proto, std::string name)
+{
+	llvm::Type *ret_type = this->builder.getVoidTy();
+	if (proto->return_type && (!(ret_type = this->type(proto->return_type.get())) || this->is_split(ret_type)))
 		return nullptr;
 
-	auto type = this->variables[expr->name].first;
-	auto ptr = this->variables[expr->name].second;
+	std::vector<llvm::Type *> param_types = {};
+	std::vector<RcKind> param_rcs = {};
+	for (auto &param : proto->params) {
+		auto type = this->type(param->type.get());
+		if (!type || this->is_split(type))
+			return nullptr;
+
+		param_types.push_back(type);
+		param_rcs.push_back(this->rc_kind(param->type.get()));
+	}
+
+	auto type = llvm::FunctionType::get(ret_type, param_types, false);
+	if (auto function = this->module.getFunction(name); function != nullptr)
+		return function->getFunctionType() == type ? function : nullptr;
+
+	auto function = llvm::Function::Create(type, this->linkage(expr), name, this->module);
+	if (function->hasLocalLinkage()) {
+		// Nobody else calls it, so it can use the faster calling convention and be merged
+		function->setCallingConv(llvm::CallingConv::Fast);
+		function->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+	} else if (function->hasLinkOnceODRLinkage()) {
+		// Instances are only ever called, so identical ones can be merged
+		function->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+	}
+	for (auto &arg : function->args())
+		arg.setName(proto->params[arg.getArgNo()]->var->name);
+
+	/*
+	 * Memory behind an immutable pointer parameter isn't written by the function, which is
+	 * enforced when it is freed, written to or handed on. If there's no mutable pointer
+	 * parameter (reference counted ones write their counter) and the function doesn't write
+	 * memory some other way, nothing else can change that memory during the call either.
+	 * `AttributeInferencePass` drops the `noalias` again for functions that do write.
+	 */
+	std::vector<bool> readonly = {};
+	bool writes_memory = false;
+	for (size_t i = 0; i < proto->params.size(); ++i) {
+		bool pointer = param_types[i]->isPointerTy();
+		readonly.push_back(pointer && !proto->params[i]->mut && param_rcs[i] == RcKind::None);
+		writes_memory |= pointer && !readonly[i];
+	}
+	for (size_t i = 0; i < proto->params.size(); ++i) {
+		auto arg = function->getArg(i);
+		if (!readonly[i])
+			continue;
+
+		arg->addAttr(llvm::Attribute::ReadOnly);
+		if (!writes_memory)
+			arg->addAttr(llvm::Attribute::NoAlias);
+	}
+
+	this->rc_params[function] = param_rcs;
+	this->rc_returns[function] = proto->return_type ? this->rc_kind(proto->return_type.get()) : RcKind::None;
+	this->pointee_returns[function] = proto->return_type ? this->pointee(proto->return_type.get()) : nullptr;
+	this->soa_returns[function] = proto->return_type ? this->elements(proto->return_type.get()) : nullptr;
 
-	return this->builder.CreateLoad(type, ptr);
+	return function;
 }
 
-llvm::Value *Codegen::eval(ExprAst *expr)
+bool Codegen::include_local(DeclarationExprAst *expr)
 {
-	if (auto str = dynamic_cast<StringExprAst *>(expr); str != nullptr)
-		return this->eval(str);
-	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr)
-		return this->eval(var);
-	if (auto var = dynamic_cast<NumberExprAst *>(expr); var != nullptr)
-		return this->eval(var);
-	if (auto var = dynamic_cast<ArrayIndexExprAst *>(expr); var != nullptr)
-		return this->eval(var);
+	// Locals are never visible outside
+	if (expr->exported)
+		return false;
 
-	return nullptr;
+	llvm::Type *type = nullptr;
+	llvm::Value *value = nullptr;
+	auto rc = RcKind::None;
+
+	if (expr->explicit_type) {
+		type = this->type(expr->explicit_type.get());
+		if (!type)
+			return false;
+		rc = this->rc_kind(expr->explicit_type.get());
+	}
+
+	if (expr->value) {
+		value = this->operand(expr->value.get(), type);
+		if (!value || value->getType()->isVoidTy())
+			return false;
+
+		if (auto value_rc = this->rc_kind(expr->value.get()); value_rc != RcKind::None) {
+			rc = value_rc;
+			// Copying a binding shares the object, the new binding owns another reference
+			if (dynamic_cast<VariableExprAst *>(expr->value.get()) != nullptr)
+				value = this->builder.CreateCall(this->rc_runtime(rc, RcOp::Retain), { value });
+		}
+
+		if (type && !(value = this->convert(value, type)))
+			return false;
+	}
+
+	bool arena = false;
+	if (auto var = dynamic_cast<VariableExprAst *>(expr->value.get()); var != nullptr)
+		arena = this->variables.count(var->name) > 0 && this->variables[var->name].arena;
+	else if (auto call = dynamic_cast<CallExprAst *>(expr->value.get()); call != nullptr)
+		arena = call->function == "alloc" && this->alloc_arena(call) != nullptr;
+	bool readonly = expr->value && this->is_readonly(expr->value.get());
+
+	if (!type)
+		type = value->getType();
+	if (this->is_split(type))
+		return false;
+
+	if (!value)
+		value = llvm::Constant::getNullValue(type);
+
+	StructLayout *pointee = nullptr;
+	StructLayout *elements = nullptr;
+	if (expr->explicit_type) {
+		pointee = this->pointee(expr->explicit_type.get());
+		elements = this->elements(expr->explicit_type.get());
+	} else if (expr->value) {
+		pointee = this->pointee(expr->value.get());
+		elements = this->elements(expr->value.get());
+	}
+
+	auto name = expr->name->name;
+	auto local_var = this->builder.CreateAlloca(type, nullptr, name);
+	local_var->setAlignment(llvm::Align(this->align_of(type)));
+	if (auto subprogram = this->builder.GetInsertBlock()->getParent()->getSubprogram(); subprogram != nullptr)
+		this->debug_info->variable(local_var, name, 0, expr->source_loc(), subprogram, this->builder.GetInsertBlock());
+	this->builder.CreateStore(value, local_var);
+	this->declare(name, Variable { type, local_var, rc, arena, expr->mut, readonly, pointee, elements });
+
+	return true;
 }
 
-llvm::Type *Codegen::type(TypeExprAst *expr)
+bool Codegen::include(CallExprAst *expr)
 {
-	llvm::Type *type = nullptr;
-	
-	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
-		auto number_regex = std::regex("[iuf]([0-9]+)$");
-		std::cmatch m;
+	return this->eval(expr) != nullptr;
+}
 
-		if (std::regex_match(basic->type.c_str(), m, number_regex)) {
-			auto nbits = atoi(m[1].str().c_str());
-			if (nbits <= 0)
-				return nullptr;
+bool Codegen::include(CodeblockExprAst *expr, llvm::Value **value)
+{
+	this->push_scope();
+	if (!this->include_statements(expr->subexprs, value))
+		return false;
 
-			if (m[0].str()[0] == 'f') {
-				switch (nbits) {
-				case 32:
-					type = this->builder.getFloatTy();
-					break;
-				case 64:
-					type = this->builder.getDoubleTy();
-					break;
-				default:
-					return nullptr;
-				}
-			} else {
-				type = this->builder.getIntNTy(static_cast<unsigned int>(nbits));
-			}
-		} else if (basic->type == "str") {
-			type = this->builder.getPtrTy();
+	return this->pop_scope();
+}
+
+// Includes the statements of a block. If `value` is given and the block ends in an
+// expression, that expression is evaluated into it as the value of the block.
+bool Codegen::include_statements(std::vector<std::unique_ptr<ExprAst>> &subexprs, llvm::Value **value)
+{
+	for (size_t i = 0; i < subexprs.size(); ++i) {
+		auto subexpr = subexprs[i].get();
+		auto location = this->locate(subexpr);
+		bool ok;
+
+		if (value && i + 1 == subexprs.size()) {
+			if (auto if_expr = dynamic_cast<IfExprAst *>(subexpr); if_expr != nullptr)
+				ok = this->include(if_expr, value);
+			else if (auto block_expr = dynamic_cast<CodeblockExprAst *>(subexpr); block_expr != nullptr)
+				ok = this->include(block_expr, value);
+			else if (this->is_value(subexpr))
+				ok = (*value = this->eval(subexpr)) != nullptr;
+			else
+				ok = this->include(subexpr);
+		} else {
+			ok = this->include(subexpr);
 		}
-	} else if (auto arr = dynamic_cast<ArrayTypeExprAst *>(expr->type.get()); arr != nullptr) {
-		auto recursing_type = this->type(arr->recursing_type.get());
-		if (!recursing_type)
-			return type;
 
-		// TODO: Implement arrays with size
-		//       Size-less arrays are just pointers
-		// type = llvm::ArrayType::get(...);
-		type = this->builder.getPtrTy();
+		if (!ok)
+			return false;
+
+		// Whatever follows a return is dead
+		if (this->is_terminated())
+			break;
 	}
 
-	return type;
+	return true;
 }
 
-llvm::Value *Codegen::eval(NumberExprAst *expr)
+// The instructions generated from here on are attributed to the line and column of `expr`,
+// until the returned scope ends. Nothing changes for functions without debug info.
+LocationScope Codegen::locate(ExprAst *expr)
 {
-	llvm::Type *type;
+	auto outer = this->builder.getCurrentDebugLocation();
+	auto block = this->builder.GetInsertBlock();
+	if (auto subprogram = block ? block->getParent()->getSubprogram() : nullptr; subprogram != nullptr)
+		this->builder.SetCurrentDebugLocation(this->debug_info->location(expr->source_loc(), subprogram));
+	return LocationScope { this->builder, outer };
+}
 
-	// TODO: Type inference or receive type in param
-	type = builder.getInt32Ty(); 
+bool Codegen::is_value(ExprAst *expr)
+{
+	return dynamic_cast<StringExprAst *>(expr) != nullptr ||
+		dynamic_cast<NumberExprAst *>(expr) != nullptr ||
+		dynamic_cast<VariableExprAst *>(expr) != nullptr ||
+		dynamic_cast<ArrayIndexExprAst *>(expr) != nullptr ||
+		dynamic_cast<CallExprAst *>(expr) != nullptr ||
+		dynamic_cast<BinaryOpExprAst *>(expr) != nullptr ||
+		dynamic_cast<MemberExprAst *>(expr) != nullptr ||
+		dynamic_cast<ComptimeExprAst *>(expr) != nullptr;
+}
 
-	llvm::Constant *value;
-	if (type->isIntegerTy()) {
-		value = llvm::Constant::getIntegerValue(type, llvm::APInt(type->getIntegerBitWidth(), expr->number, 10));
-	} else {
-		value = llvm::ConstantFP::get(type, expr->number);
+// Token Patterns: if <Expr> <Codeblock> (else (<Codeblock> | <If>))?
+// If `value` is given and every branch that falls through yields a value, the result is their phi
+bool Codegen::include(IfExprAst *expr, llvm::Value **value)
+{
+	if (!this->builder.GetInsertBlock())
+		return false;
+
+	auto cond = this->eval(expr->condition.get());
+	if (!cond || !(cond = this->condition(cond)))
+		return false;
+
+	auto function = this->builder.GetInsertBlock()->getParent();
+	auto then_block = llvm::BasicBlock::Create(this->context, "then", function);
+	auto else_block = expr->else_body ? llvm::BasicBlock::Create(this->context, "else", function) : nullptr;
+	auto merge_block = llvm::BasicBlock::Create(this->context, "endif", function);
+	this->builder.CreateCondBr(cond, then_block, else_block ? else_block : merge_block);
+
+	std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> incoming;
+	bool complete = else_block != nullptr; // Without an `else` there's a path without a value
+	auto branch = [&](ExprAst *body, llvm::BasicBlock *block) {
+		this->builder.SetInsertPoint(block);
+
+		llvm::Value *result = nullptr;
+		bool ok;
+		if (auto nested = dynamic_cast<IfExprAst *>(body); nested != nullptr)
+			ok = this->include(nested, value ? &result : nullptr);
+		else
+			ok = this->include(static_cast<CodeblockExprAst *>(body), value ? &result : nullptr);
+		if (!ok)
+			return false;
+
+		if (!this->is_terminated()) {
+			if (result && !result->getType()->isVoidTy())
+				incoming.push_back({ result, this->builder.GetInsertBlock() });
+			else
+				complete = false;
+			this->builder.CreateBr(merge_block);
+		}
+
+		return true;
+	};
+
+	if (!branch(expr->then_body.get(), then_block))
+		return false;
+	if (else_block && !branch(expr->else_body.get(), else_block))
+		return false;
+
+	// Nothing falls through when every branch returns
+	this->builder.SetInsertPoint(merge_block);
+	if (merge_block->hasNPredecessors(0)) {
+		this->builder.CreateUnreachable();
+		return true;
+	}
+
+	if (!value || !complete || incoming.empty())
+		return true;
+
+	auto type = incoming[0].first->getType();
+	for (auto &[result, block] : incoming) {
+		if (!(type = this->common_type(type, result->getType())))
+			return false;
 	}
 
+	for (auto &[result, block] : incoming) {
+		this->builder.SetInsertPoint(block->getTerminator());
+		if (!(result = this->convert(result, type)))
+			return false;
+	}
+
+	this->builder.SetInsertPoint(merge_block);
+	auto phi = this->builder.CreatePHI(type, incoming.size());
+	for (auto [result, block] : incoming)
+		phi->addIncoming(result, block);
+	*value = phi;
+
+	return true;
+}
+
+llvm::Value *Codegen::eval(IfExprAst *expr)
+{
+	llvm::Value *value = nullptr;
+	if (!this->include(expr, &value))
+		return nullptr;
+
 	return value;
 }
 
-llvm::Value *Codegen::eval(ArrayIndexExprAst *expr)
+// Roughly one instruction per node, counted on the AST so deciding how to expand a cleanup
+// doesn't emit anything
+static size_t estimate_cost(ExprAst *expr)
 {
-	if (this->variables.find(expr->var->name) == this->variables.end())
+	if (!expr)
+		return 0;
+
+	if (auto block_expr = dynamic_cast<CodeblockExprAst *>(expr); block_expr != nullptr) {
+		size_t cost = 0;
+		for (auto &subexpr : block_expr->subexprs)
+			cost += estimate_cost(subexpr.get());
+		return cost;
+	}
+
+	if (auto call_expr = dynamic_cast<CallExprAst *>(expr); call_expr != nullptr) {
+		size_t cost = 1;
+		for (auto &arg : call_expr->args)
+			cost += estimate_cost(arg.get());
+		return cost;
+	}
+
+	if (auto decl_expr = dynamic_cast<DeclarationExprAst *>(expr); decl_expr != nullptr)
+		return 1 + estimate_cost(decl_expr->value.get());
+
+	if (auto assign_expr = dynamic_cast<AssignExprAst *>(expr); assign_expr != nullptr)
+		return estimate_cost(assign_expr->target.get()) + estimate_cost(assign_expr->value.get());
+
+	if (auto binop_expr = dynamic_cast<BinaryOpExprAst *>(expr); binop_expr != nullptr)
+		return 1 + estimate_cost(binop_expr->left.get()) + estimate_cost(binop_expr->right.get());
+
+	if (auto member_expr = dynamic_cast<MemberExprAst *>(expr); member_expr != nullptr)
+		return 1 + estimate_cost(member_expr->object.get());
+
+	if (auto index_expr = dynamic_cast<ArrayIndexExprAst *>(expr); index_expr != nullptr)
+		return 2 + estimate_cost(index_expr->index.get());
+
+	if (auto if_expr = dynamic_cast<IfExprAst *>(expr); if_expr != nullptr)
+		return 2 + estimate_cost(if_expr->condition.get()) + estimate_cost(if_expr->then_body.get()) +
+		       estimate_cost(if_expr->else_body.get());
+
+	if (auto arena_expr = dynamic_cast<ArenaExprAst *>(expr); arena_expr != nullptr)
+		return 2 + estimate_cost(arena_expr->body.get());
+
+	// Constants and comptime values fold away, a variable is a load
+	if (dynamic_cast<VariableExprAst *>(expr) != nullptr)
+		return 1;
+	return 0;
+}
+
+bool Codegen::include(DeferExprAst *expr)
+{
+	if (this->scopes.empty())
+		return false;
+
+	// The deferred expression sees the bindings of where it was written, not of the exit it runs at
+	auto bindings = this->variables;
+	auto deferred = expr->expr.get();
+	this->scopes.back().cleanups.push_back(Cleanup { [this, bindings, deferred]() {
+		auto current = std::move(this->variables);
+		this->variables = bindings;
+		bool ok = this->include(deferred);
+		this->variables = std::move(current);
+		return ok;
+	}, estimate_cost(deferred) });
+
+	return true;
+}
+
+bool Codegen::include(ReturnExprAst *expr)
+{
+	if (this->scopes.empty())
+		return false;
+
+	auto ret_type = this->builder.GetInsertBlock()->getParent()->getReturnType();
+	if (ret_type->isVoidTy() != (expr->value == nullptr))
+		return false;
+
+	llvm::Value *value = nullptr;
+	if (expr->value) {
+		value = this->operand(expr->value.get(), ret_type);
+		if (!value || !(value = this->convert(this->owned(expr->value.get(), value), ret_type)))
+			return false;
+	}
+
+	return this->exit_scopes(this->scopes.size(), 0, nullptr, value);
+}
+
+/*
+ * Token Patterns: [Become] <Call>
+ *
+ * A guaranteed tail call: the callee replaces the frame of the current function, so
+ * state machines and mutual recursion run in constant stack space. The call is emitted
+ * as `musttail`, which needs identical prototypes and calling conventions on both sides.
+ * Internal functions already use `fastcc`, exported ones can only become each other.
+ */
+bool Codegen::include(BecomeExprAst *expr)
+{
+	if (this->scopes.empty() || !this->builder.GetInsertBlock())
+		return false;
+
+	auto call_expr = expr->call.get();
+	auto caller = this->builder.GetInsertBlock()->getParent();
+	auto callee = this->callee(call_expr);
+	if (!callee || callee->getFunctionType() != caller->getFunctionType() ||
+	    callee->getCallingConv() != caller->getCallingConv())
+		return false;
+
+	// Nothing can run after the call, so reference counted arguments have to be handed
+	// over to the callee instead of being released by us afterwards
+	auto &param_rcs = this->rc_params[callee];
+	for (size_t i = 0; i < call_expr->args.size(); ++i) {
+		if (this->rc_kind(call_expr->args[i].get()) != RcKind::None && (i >= param_rcs.size() || param_rcs[i] == RcKind::None))
+			return false;
+	}
+
+	std::vector<llvm::Value *> args;
+	std::vector<std::pair<RcKind, llvm::Value *>> temporaries;
+	if (!this->call_args(call_expr, callee, args, temporaries))
+		return false;
+
+	// The frame is gone once the callee runs, every cleanup happens before the call
+	for (size_t i = this->scopes.size(); i-- > 0;) {
+		if (!this->emit_cleanups(this->scopes[i], this->scopes[i].cleanups.size()))
+			return false;
+	}
+
+	auto call = this->builder.CreateCall(callee, args);
+	call->setCallingConv(callee->getCallingConv());
+	call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+	if (call->getType()->isVoidTy())
+		this->builder.CreateRetVoid();
+	else
+		this->builder.CreateRet(call);
+
+	return true;
+}
+
+llvm::Value *Codegen::eval(CallExprAst *expr)
+{
+	if (expr->function == "rcalloc" || expr->function == "arcalloc")
+		return this->rc_alloc(expr);
+	if (expr->function == "alloc")
+		return this->alloc(expr);
+	if (expr->function == "soa")
+		return this->soa_alloc(expr);
+	if (expr->function == "len" && expr->args.size() == 1 && this->elements(expr->args[0].get()) != nullptr)
+		return this->soa_len(expr);
+	if (expr->function == "free" && expr->type_args.empty() && expr->args.size() == 1) {
+		if (this->is_readonly(expr->args[0].get()))
+			return nullptr;
+
+		auto ptr = this->eval(expr->args[0].get());
+		if (!ptr)
+			return nullptr;
+
+		// Arena memory goes away with its arena
+		if (this->alloc_arena(expr) != nullptr)
+			return ptr;
+
+		auto free_func = this->module.getOrInsertFunction("free", this->builder.getVoidTy(), this->builder.getPtrTy());
+		if (auto layout = this->pointee(expr->args[0].get()); layout && layout->cold.type) {
+			auto cold_ptr = this->builder.CreateStructGEP(layout->hot.type, ptr, layout->cold_index);
+			auto cold_align = llvm::commonAlignment(llvm::Align(layout->hot.align), layout->cold_offset);
+			this->builder.CreateCall(free_func, { this->builder.CreateAlignedLoad(this->builder.getPtrTy(), cold_ptr, cold_align) });
+		}
+
+		return this->builder.CreateCall(free_func, { ptr });
+	}
+
+	auto function = this->callee(expr);
+	if (!function)
 		return nullptr;
 
-	auto arr = this->variables[expr->var->name].second;
-	if (!arr)
+	std::vector<llvm::Value *> args;
+	std::vector<std::pair<RcKind, llvm::Value *>> temporaries;
+	if (!this->call_args(expr, function, args, temporaries))
 		return nullptr;
 
-	auto loaded_arr = this->builder.CreateLoad(builder.getPtrTy(), arr, "__array_loaded__");
+	auto call = this->builder.CreateCall(function, args);
+	call->setCallingConv(function->getCallingConv());
+	for (auto [rc, temporary] : temporaries)
+		this->builder.CreateCall(this->rc_runtime(rc, RcOp::Release), { temporary });
 
-	auto index = this->eval(expr->index.get());
-	if (!index)
-		return nullptr;
+	return call;
+}
 
-	auto deref = this->builder.getInt32(0);
-	auto type = llvm::ArrayType::get(this->builder.getPtrTy(), 64); // TODO: Just don't do this. This is such a hack
-	auto bigtype = llvm::ArrayType::get(type, 64); // TODO: Just don't do this. This is such a hack
-	auto ptr = this->builder.CreateGEP(bigtype, loaded_arr, { deref,  index, index }, "__array_deref__");
-	auto ptr_load = this->builder.CreateLoad(builder.getPtrTy(), ptr, "__array_value__");
+// The function a call refers to, generic functions are instantiated for the call's type arguments
+llvm::Function *Codegen::callee(CallExprAst *expr)
+{
+	if (auto generic = this->generics.find(expr->function); generic != this->generics.end())
+		return this->instantiate(generic->second, expr->type_args);
+	if (!expr->type_args.empty())
+		return nullptr;
 
-	return ptr_load;
+	return this->module.getFunction(expr->function);
 }
 
-bool Codegen::include(ExprAst *expr)
+/*
+ * Generic functions are monomorphized: every distinct list of type arguments gets its own
+ * instance, with the type parameters bound to the arguments, so generic code runs as fast
+ * as code written for the concrete types. An instance is generated once on first use,
+ * later calls find it in `instances`. Its symbol spells out the type arguments, e.g.
+ * `max<i32>`, so modules using the same `pub` instance agree on it.
+ */
+llvm::Function *Codegen::instantiate(DeclarationExprAst *expr, std::vector<std::unique_ptr<TypeExprAst>> &type_args)
 {
-	if (auto decl_expr = dynamic_cast<DeclarationExprAst *>(expr); decl_expr != nullptr)
-		return this->include(decl_expr);
+	auto func = static_cast<FunctionExprAst *>(expr->value.get());
+	auto &type_params = func->proto->type_params;
+	if (type_args.size() != type_params.size())
+		return nullptr;
 
-	if (auto call_expr = dynamic_cast<CallExprAst *>(expr); call_expr != nullptr)
-		return this->include(call_expr);
+	// Type arguments may use the type parameters of the instance they're written in
+	std::vector<std::unique_ptr<TypeExprAst>> types;
+	std::string name = expr->name->name + "<";
+	for (size_t i = 0; i < type_args.size(); ++i) {
+		auto type = this->substitute(type_args[i].get());
+		if (!type || !this->type(type.get()))
+			return nullptr;
 
-	return false;
+		name += (i > 0 ? "," : "") + this->mangle(type.get());
+		types.push_back(std::move(type));
+	}
+	name += ">";
+
+	auto key = std::make_pair(expr, name);
+	if (auto instance = this->instances.find(key); instance != this->instances.end())
+		return instance->second;
+
+	// Instances instantiating ever bigger types never end
+	if (this->instantiation_depth >= 64)
+		return nullptr;
+
+	std::map<std::string, TypeExprAst *> bindings;
+	for (size_t i = 0; i < types.size(); ++i) {
+		bindings[type_params[i]] = types[i].get();
+		this->instance_types.push_back(std::move(types[i]));
+	}
+
+	// The instance is generated on its own, it only sees the globals and not the function that needs it
+	auto insert_point = this->builder.saveIP();
+	auto variables = this->variables;
+	for (size_t i = this->scopes.size(); i-- > 0;) {
+		for (auto &[name, prev] : this->scopes[i].shadowed) {
+			if (prev)
+				this->variables[name] = *prev;
+			else
+				this->variables.erase(name);
+		}
+	}
+	auto scopes = std::move(this->scopes);
+	auto arenas = std::move(this->arenas);
+	auto return_slot = this->return_slot;
+	auto outer_bindings = std::move(this->type_bindings);
+	this->scopes.clear();
+	this->arenas.clear();
+	this->type_bindings = bindings;
+	this->builder.ClearInsertionPoint();
+	++this->instantiation_depth;
+
+	// Registered before the body, so recursive calls find it
+	auto function = this->prototype(expr, func->proto.get(), name);
+	this->instances[key] = function;
+	bool ok = function && function->isDeclaration() && this->define(function, func);
+
+	--this->instantiation_depth;
+	this->type_bindings = std::move(outer_bindings);
+	this->return_slot = return_slot;
+	this->arenas = std::move(arenas);
+	this->scopes = std::move(scopes);
+	this->variables = std::move(variables);
+	this->builder.restoreIP(insert_point);
+
+	return ok ? function : nullptr;
+}
+
+// Copies a type with the type parameters of the current instance replaced by their arguments
+std::unique_ptr<TypeExprAst> Codegen::substitute(TypeExprAst *expr)
+{
+	auto loc = expr->source_loc();
+
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
+		if (auto bound = this->type_bindings.find(basic->type); bound != this->type_bindings.end())
+			return this->substitute(bound->second);
+
+		return std::make_unique<TypeExprAst>(loc, std::make_unique<BasicTypeExprAst>(basic->source_loc(), basic->type));
+	} else if (auto pointer = dynamic_cast<PointerTypeExprAst *>(expr->type.get()); pointer != nullptr) {
+		auto pointee = this->substitute(pointer->pointee.get());
+		if (!pointee)
+			return nullptr;
+
+		return std::make_unique<TypeExprAst>(loc, std::make_unique<PointerTypeExprAst>(pointer->source_loc(), std::move(pointee)));
+	} else if (auto arr = dynamic_cast<ArrayTypeExprAst *>(expr->type.get()); arr != nullptr) {
+		auto recursing_type = this->substitute(arr->recursing_type.get());
+		if (!recursing_type)
+			return nullptr;
+
+		return std::make_unique<TypeExprAst>(loc, std::make_unique<ArrayTypeExprAst>(arr->source_loc(), std::move(recursing_type)));
+	} else if (auto generic = dynamic_cast<GenericTypeExprAst *>(expr->type.get()); generic != nullptr) {
+		std::vector<std::unique_ptr<TypeExprAst>> args;
+		for (auto &arg : generic->args) {
+			auto type = this->substitute(arg.get());
+			if (!type)
+				return nullptr;
+			args.push_back(std::move(type));
+		}
+
+		return std::make_unique<TypeExprAst>(loc, std::make_unique<GenericTypeExprAst>(generic->source_loc(), generic->name, std::move(args)));
+	}
+
+	// TODO: Function types as type arguments
+	return nullptr;
+}
+
+// The spelling of a type in the symbol of an instance, e.g. `*i32` or `rc<f64>`
+std::string Codegen::mangle(TypeExprAst *expr)
+{
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr)
+		return basic->type;
+	if (auto pointer = dynamic_cast<PointerTypeExprAst *>(expr->type.get()); pointer != nullptr)
+		return "*" + this->mangle(pointer->pointee.get());
+	if (auto arr = dynamic_cast<ArrayTypeExprAst *>(expr->type.get()); arr != nullptr)
+		return "[]" + this->mangle(arr->recursing_type.get());
+
+	auto generic = static_cast<GenericTypeExprAst *>(expr->type.get());
+	std::string name = generic->name + "<";
+	for (size_t i = 0; i < generic->args.size(); ++i)
+		name += (i > 0 ? "," : "") + this->mangle(generic->args[i].get());
+
+	return name + ">";
+}
+
+bool Codegen::call_args(CallExprAst *expr, llvm::Function *function, std::vector<llvm::Value *> &args,
+                        std::vector<std::pair<RcKind, llvm::Value *>> &temporaries)
+{
+	auto type = function->getFunctionType();
+	if (expr->args.size() < type->getNumParams() || (!type->isVarArg() && expr->args.size() > type->getNumParams()))
+		return false;
+
+	auto param_rcs = this->rc_params.find(function);
+	for (size_t i = 0; i < expr->args.size(); ++i) {
+		auto arg_expr = expr->args[i].get();
+		auto param_type = i < type->getNumParams() ? type->getParamType(i) : nullptr;
+		if (param_type && this->is_readonly(arg_expr) && !function->getArg(i)->hasAttribute(llvm::Attribute::ReadOnly))
+			return false;
+
+		auto arg = this->operand(arg_expr, param_type);
+		if (!arg)
+			return false;
+
+		// Variadic arguments get the C default argument promotions
+		if (param_type)
+			arg = this->convert(arg, param_type);
+		else if (arg->getType()->isFloatTy())
+			arg = this->builder.CreateFPExt(arg, this->builder.getDoubleTy());
+		else if (arg->getType()->isIntegerTy() && arg->getType()->getIntegerBitWidth() < 32)
+			arg = this->convert(arg, this->builder.getInt32Ty());
+		if (!arg)
+			return false;
+
+		// Reference counted parameters are owned by the callee: bindings hand over a new
+		// reference, temporaries hand over theirs. Anything else only borrows, so the
+		// temporaries have to be released by us after the call.
+		auto arg_rc = this->rc_kind(arg_expr);
+		auto owned = param_rcs != this->rc_params.end() && i < param_rcs->second.size() &&
+			param_rcs->second[i] != RcKind::None;
+		if (arg_rc != RcKind::None) {
+			bool temporary = dynamic_cast<VariableExprAst *>(arg_expr) == nullptr;
+			if (owned && !temporary)
+				arg = this->builder.CreateCall(this->rc_runtime(arg_rc, RcOp::Retain), { arg });
+			else if (!owned && temporary)
+				temporaries.push_back({ arg_rc, arg });
+		}
+
+		args.push_back(arg);
+	}
+
+	return true;
+}
+
+llvm::Value *Codegen::eval(StringExprAst *str)
+{
+	auto value = this->builder.CreateGlobalStringPtr(str->value, "", 0, &this->module);
+	return value;
+}
+
+llvm::Value *Codegen::eval(VariableExprAst *expr)
+{
+	if (this->variables.find(expr->name) == this->variables.end())
+		return nullptr;
+
+	auto type = this->variables[expr->name].type;
+	auto ptr = this->variables[expr->name].value;
+
+	// Tables are used through a pointer to their first element, like any array
+	if (type->isArrayTy())
+		return ptr;
+
+	auto load = this->builder.CreateLoad(type, ptr);
+
+	// Immutable globals never change, so their loads can be hoisted and merged freely
+	if (auto global = llvm::dyn_cast<llvm::GlobalVariable>(ptr); global != nullptr && global->isConstant())
+		load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(this->context, {}));
+
+	return load;
+}
+
+bool Codegen::include(AssignExprAst *expr)
+{
+	if (auto member = dynamic_cast<MemberExprAst *>(expr->target.get()); member != nullptr) {
+		FieldAccess access;
+		auto ptr = this->address(member, true, access);
+		if (!ptr)
+			return false;
+
+		auto type = access.field->type;
+		auto value = this->operand(expr->value.get(), type);
+		if (!value || !(value = this->convert(value, type)))
+			return false;
+
+		// Memory that is only lent to us can't be put where others find it
+		if (this->is_readonly(expr->value.get()))
+			return false;
+
+		auto store = this->builder.CreateAlignedStore(value, ptr, llvm::Align(access.align));
+		store->setAAMetadata(access.aliasing);
+		return true;
+	}
+
+	auto target = dynamic_cast<VariableExprAst *>(expr->target.get());
+	auto it = target ? this->variables.find(target->name) : this->variables.end();
+	if (it == this->variables.end() || !it->second.mut)
+		return false;
+
+	auto var = it->second;
+	auto value = this->operand(expr->value.get(), var.type);
+	if (!value || !(value = this->convert(value, var.type)))
+		return false;
+
+	// The binding gives up its old reference and owns the new one
+	if (var.rc != RcKind::None) {
+		if (this->rc_kind(expr->value.get()) != var.rc)
+			return false;
+		if (dynamic_cast<VariableExprAst *>(expr->value.get()) != nullptr)
+			value = this->builder.CreateCall(this->rc_runtime(var.rc, RcOp::Retain), { value });
+
+		auto old = this->builder.CreateLoad(var.type, var.value);
+		this->builder.CreateStore(value, var.value);
+		this->builder.CreateCall(this->rc_runtime(var.rc, RcOp::Release), { old });
+		return true;
+	}
+
+	// Arena memory can't be mixed with memory that has to be freed
+	bool arena = false;
+	if (auto other = dynamic_cast<VariableExprAst *>(expr->value.get()); other != nullptr)
+		arena = this->variables.count(other->name) > 0 && this->variables[other->name].arena;
+	else if (auto call = dynamic_cast<CallExprAst *>(expr->value.get()); call != nullptr)
+		arena = call->function == "alloc" && this->alloc_arena(call) != nullptr;
+	if (arena != var.arena)
+		return false;
+
+	// Other functions can see globals, they don't know about the promise
+	bool readonly = this->is_readonly(expr->value.get());
+	if (readonly && llvm::isa<llvm::GlobalVariable>(var.value))
+		return false;
+
+	it->second.readonly |= readonly;
+	this->builder.CreateStore(value, var.value);
+	return true;
+}
+
+// Pointers to memory the current function has promised not to write
+bool Codegen::is_readonly(ExprAst *expr)
+{
+	auto var = dynamic_cast<VariableExprAst *>(expr);
+	if (!var)
+		return false;
+
+	auto it = this->variables.find(var->name);
+	return it != this->variables.end() && it->second.readonly;
+}
+
+llvm::Value *Codegen::eval(ExprAst *expr)
+{
+	auto location = this->locate(expr);
+	if (auto str = dynamic_cast<StringExprAst *>(expr); str != nullptr)
+		return this->eval(str);
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr)
+		return this->eval(var);
+	if (auto var = dynamic_cast<NumberExprAst *>(expr); var != nullptr)
+		return this->eval(var);
+	if (auto var = dynamic_cast<ArrayIndexExprAst *>(expr); var != nullptr)
+		return this->eval(var);
+	if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr)
+		return this->eval(call);
+	if (auto binop = dynamic_cast<BinaryOpExprAst *>(expr); binop != nullptr)
+		return this->eval(binop);
+	if (auto if_expr = dynamic_cast<IfExprAst *>(expr); if_expr != nullptr)
+		return this->eval(if_expr);
+	if (auto member = dynamic_cast<MemberExprAst *>(expr); member != nullptr)
+		return this->eval(member);
+	if (auto comptime = dynamic_cast<ComptimeExprAst *>(expr); comptime != nullptr)
+		return this->eval(comptime);
+
+	return nullptr;
+}
+
+// Token Patterns: comptime <Expr>
+llvm::Value *Codegen::eval(ComptimeExprAst *expr, llvm::Type *hint)
+{
+	this->target();
+
+	// Like everywhere else, only a number literal takes the type that is expected of it
+	auto number = dynamic_cast<NumberExprAst *>(expr->expr.get());
+	auto value = this->comptime.run(expr->expr.get(), number ? hint : nullptr);
+	if (!value) {
+		std::cout << "[ERR] " << this->comptime.error << std::endl;
+		return nullptr;
+	}
+
+	// Tables need a global to live in
+	if (value->getType()->isArrayTy())
+		return nullptr;
+
+	return value;
+}
+
+llvm::Type *Codegen::type(TypeExprAst *expr)
+{
+	llvm::Type *type = nullptr;
+	
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
+		if (auto bound = this->type_bindings.find(basic->type); bound != this->type_bindings.end())
+			return this->type(bound->second);
+		if (auto layout = this->structs.find(basic->type); layout != this->structs.end())
+			return layout->second.hot.type;
+
+		auto number_regex = std::regex("[iuf]([0-9]+)$");
+		std::cmatch m;
+
+		if (std::regex_match(basic->type.c_str(), m, number_regex)) {
+			auto nbits = atoi(m[1].str().c_str());
+			if (nbits <= 0)
+				return nullptr;
+
+			if (m[0].str()[0] == 'f') {
+				switch (nbits) {
+				case 32:
+					type = this->builder.getFloatTy();
+					break;
+				case 64:
+					type = this->builder.getDoubleTy();
+					break;
+				default:
+					return nullptr;
+				}
+			} else {
+				type = this->builder.getIntNTy(static_cast<unsigned int>(nbits));
+			}
+		} else if (basic->type == "str") {
+			type = this->builder.getPtrTy();
+		}
+	} else if (auto arr = dynamic_cast<ArrayTypeExprAst *>(expr->type.get()); arr != nullptr) {
+		auto recursing_type = this->type(arr->recursing_type.get());
+		if (!recursing_type)
+			return type;
+
+		// TODO: Implement arrays with size
+		//       Size-less arrays are just pointers
+		// type = llvm::ArrayType::get(...);
+		type = this->builder.getPtrTy();
+	} else if (auto pointer = dynamic_cast<PointerTypeExprAst *>(expr->type.get()); pointer != nullptr) {
+		if (!this->type(pointer->pointee.get()))
+			return nullptr;
+
+		type = this->builder.getPtrTy();
+	} else if (auto generic = dynamic_cast<GenericTypeExprAst *>(expr->type.get()); generic != nullptr) {
+		if ((generic->name == "rc" || generic->name == "arc") && generic->args.size() == 1) {
+			if (!this->type(generic->args[0].get()))
+				return nullptr;
+
+			// Reference counted objects are handed around as pointers to their payload
+			type = this->builder.getPtrTy();
+		} else if (generic->name == "soa" && generic->args.size() == 1) {
+			if (!this->layout(this->type(generic->args[0].get())))
+				return nullptr;
+
+			// A pointer to the header of the arrays
+			type = this->builder.getPtrTy();
+		}
+	}
+
+	return type;
+}
+
+// Token Patterns: Name := struct { ... }
+bool Codegen::define_struct(DeclarationExprAst *expr, StructTypeExprAst *type)
+{
+	auto name = expr->name->name;
+	if (this->structs.count(name) > 0)
+		return false;
+
+	this->target();
+	auto &data_layout = this->module.getDataLayout();
+
+	// Registered before the fields are looked at, so they can point to the struct itself
+	auto &layout = this->structs[name];
+	layout.name = name;
+	layout.packed = type->packed;
+	layout.hot.type = llvm::StructType::create(this->context, name);
+
+	for (auto &field : type->fields) {
+		// Fields stored in place need a complete type. Reference counted ones would have to be
+		// released together with the struct, which nothing keeps track of.
+		auto field_type = this->type(field->type.get());
+		if (!field_type || !field_type->isSized() || this->is_split(field_type) ||
+		    this->rc_kind(field->type.get()) != RcKind::None || layout.field(field->name) != nullptr) {
+			this->structs.erase(name);
+			return false;
+		}
+
+		StructField info { field->name, this->mangle(field->type.get()), field->type.get(), field_type,
+		                   data_layout.getTypeAllocSize(field_type).getFixedValue(), this->align_of(field_type) };
+		info.align = field->align;
+		info.cold = field->cold;
+		layout.fields.push_back(info);
+	}
+
+	layout.compute(this->context, data_layout);
+	if (this->options.dump_struct_layouts)
+		layout.print(std::cout);
+
+	return true;
+}
+
+StructLayout *Codegen::layout(llvm::Type *type)
+{
+	auto struct_type = llvm::dyn_cast_or_null<llvm::StructType>(type);
+	if (!struct_type || !struct_type->hasName())
+		return nullptr;
+
+	auto it = this->structs.find(struct_type->getName().str());
+	return it != this->structs.end() && it->second.hot.type == struct_type ? &it->second : nullptr;
+}
+
+// Structs with `@cold` fields only live behind pointers, a copy would share the cold part
+bool Codegen::is_split(llvm::Type *type)
+{
+	auto layout = this->layout(type);
+	return layout && layout->cold.type;
+}
+
+// Structs are packed LLVM structs with explicit padding, their alignment is our own
+uint64_t Codegen::align_of(llvm::Type *type)
+{
+	if (auto layout = this->layout(type); layout != nullptr)
+		return layout->hot.align;
+
+	return this->module.getDataLayout().getABITypeAlign(type).value();
+}
+
+// The struct behind a pointer (or reference counted) type
+StructLayout *Codegen::pointee(TypeExprAst *expr)
+{
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
+		auto bound = this->type_bindings.find(basic->type);
+		return bound != this->type_bindings.end() ? this->pointee(bound->second) : nullptr;
+	}
+
+	if (auto pointer = dynamic_cast<PointerTypeExprAst *>(expr->type.get()); pointer != nullptr)
+		return this->layout(this->type(pointer->pointee.get()));
+
+	auto generic = dynamic_cast<GenericTypeExprAst *>(expr->type.get());
+	if (generic && (generic->name == "rc" || generic->name == "arc") && generic->args.size() == 1)
+		return this->layout(this->type(generic->args[0].get()));
+
+	return nullptr;
+}
+
+// The struct behind the pointer an expression evaluates to
+StructLayout *Codegen::pointee(ExprAst *expr)
+{
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr) {
+		auto it = this->variables.find(var->name);
+		return it != this->variables.end() ? it->second.pointee : nullptr;
+	}
+
+	if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr) {
+		if ((call->function == "alloc" || call->function == "rcalloc" || call->function == "arcalloc") &&
+		    call->type_args.size() == 1)
+			return this->layout(this->type(call->type_args[0].get()));
+
+		auto function = this->callee(call);
+		auto it = function ? this->pointee_returns.find(function) : this->pointee_returns.end();
+		return it != this->pointee_returns.end() ? it->second : nullptr;
+	}
+
+	if (auto member = dynamic_cast<MemberExprAst *>(expr); member != nullptr) {
+		bool by_value;
+		auto layout = this->struct_of(member->object.get(), by_value);
+		auto field = layout ? layout->field(member->field) : nullptr;
+		return field ? this->pointee(field->decl) : nullptr;
+	}
+
+	return nullptr;
+}
+
+// The struct `expr.field` looks into, `expr` is either the struct itself or a pointer to it
+StructLayout *Codegen::struct_of(ExprAst *expr, bool &by_value)
+{
+	by_value = true;
+
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr) {
+		auto it = this->variables.find(var->name);
+		if (it == this->variables.end())
+			return nullptr;
+		if (auto layout = this->layout(it->second.type); layout != nullptr)
+			return layout;
+	} else if (auto member = dynamic_cast<MemberExprAst *>(expr); member != nullptr) {
+		bool outer_by_value;
+		auto outer = this->struct_of(member->object.get(), outer_by_value);
+		auto field = outer ? outer->field(member->field) : nullptr;
+		if (!field)
+			return nullptr;
+		if (auto layout = this->layout(field->type); layout != nullptr)
+			return layout;
+	} else if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr) {
+		auto function = this->callee(call);
+		if (auto layout = function ? this->layout(function->getReturnType()) : nullptr; layout != nullptr)
+			return layout;
+	} else if (auto index = dynamic_cast<ArrayIndexExprAst *>(expr); index != nullptr) {
+		// An element of a `soa<T>` is in place, but each of its fields is somewhere else
+		if (auto layout = this->elements(index->var.get()); layout != nullptr)
+			return layout;
+	}
+
+	by_value = false;
+	return this->pointee(expr);
+}
+
+// The address of a field, in place in a struct binding or behind a pointer to the struct, and the
+// alignment it has there. Writing needs a `mut` binding or a pointer the function may write through.
+llvm::Value *Codegen::address(MemberExprAst *expr, bool write, FieldAccess &access)
+{
+	bool by_value;
+	auto object = expr->object.get();
+	auto layout = this->struct_of(object, by_value);
+	auto field = layout ? layout->field(expr->field) : nullptr;
+	if (!field)
+		return nullptr;
+
+	access.field = field;
+	access.align = field->access_align;
+	if (auto index = dynamic_cast<ArrayIndexExprAst *>(object); index != nullptr)
+		return this->soa_element(index, layout, write, access);
+
+	llvm::Value *base = nullptr;
+	if (!by_value) {
+		if (write && this->is_readonly(object))
+			return nullptr;
+		base = this->eval(object);
+	} else if (auto var = dynamic_cast<VariableExprAst *>(object); var != nullptr) {
+		auto &binding = this->variables[var->name];
+		if (write && !binding.mut)
+			return nullptr;
+		base = binding.value;
+	} else if (auto member = dynamic_cast<MemberExprAst *>(object); member != nullptr) {
+		// A struct inside of a `soa<T>` element is in the array of its field
+		FieldAccess outer;
+		base = this->address(member, write, outer);
+		access.aliasing = outer.aliasing;
+	}
+	if (!base)
+		return nullptr;
+
+	if (!field->cold)
+		return this->builder.CreateStructGEP(layout->hot.type, base, field->index, field->name);
+
+	auto cold_ptr = this->builder.CreateStructGEP(layout->hot.type, base, layout->cold_index);
+	auto cold_align = llvm::commonAlignment(llvm::Align(layout->hot.align), layout->cold_offset);
+	auto cold = this->builder.CreateAlignedLoad(this->builder.getPtrTy(), cold_ptr, cold_align, "cold");
+	return this->builder.CreateStructGEP(layout->cold.type, cold, field->index, field->name);
+}
+
+llvm::Value *Codegen::eval(MemberExprAst *expr)
+{
+	// A struct returned by a call isn't stored anywhere, the field is taken out of the value
+	bool by_value;
+	auto layout = this->struct_of(expr->object.get(), by_value);
+	if (layout && by_value && dynamic_cast<CallExprAst *>(expr->object.get()) != nullptr) {
+		auto field = layout->field(expr->field);
+		auto value = field ? this->eval(expr->object.get()) : nullptr;
+		return value ? this->builder.CreateExtractValue(value, field->index, field->name) : nullptr;
+	}
+
+	FieldAccess access;
+	auto ptr = this->address(expr, false, access);
+	if (!ptr)
+		return nullptr;
+
+	auto load = this->builder.CreateAlignedLoad(access.field->type, ptr, llvm::Align(access.align), access.field->name);
+	load->setAAMetadata(access.aliasing);
+	return load;
+}
+
+// The struct a `soa<T>` type stores
+StructLayout *Codegen::elements(TypeExprAst *expr)
+{
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
+		auto bound = this->type_bindings.find(basic->type);
+		return bound != this->type_bindings.end() ? this->elements(bound->second) : nullptr;
+	}
+
+	auto generic = dynamic_cast<GenericTypeExprAst *>(expr->type.get());
+	if (generic && generic->name == "soa" && generic->args.size() == 1)
+		return this->layout(this->type(generic->args[0].get()));
+
+	return nullptr;
+}
+
+// The struct the `soa<T>` an expression evaluates to stores
+StructLayout *Codegen::elements(ExprAst *expr)
+{
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr) {
+		auto it = this->variables.find(var->name);
+		return it != this->variables.end() ? it->second.elements : nullptr;
+	}
+
+	if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr) {
+		if (call->function == "soa" && call->type_args.size() == 1)
+			return this->layout(this->type(call->type_args[0].get()));
+
+		auto function = this->callee(call);
+		auto it = function ? this->soa_returns.find(function) : this->soa_returns.end();
+		return it != this->soa_returns.end() ? it->second : nullptr;
+	}
+
+	return nullptr;
+}
+
+// The length of a `soa<T>` and a pointer to each of its arrays, in declaration order of the fields
+llvm::StructType *Codegen::soa_header(StructLayout *layout)
+{
+	std::vector<llvm::Type *> elements = { this->builder.getInt64Ty() };
+	elements.insert(elements.end(), layout->fields.size(), this->builder.getPtrTy());
+	return llvm::StructType::get(this->context, elements);
+}
+
+// The arrays start on cache line boundaries, which is good for any vector width
+uint64_t Codegen::soa_align(StructLayout *layout)
+{
+	uint64_t align = 64;
+	for (auto &field : layout->fields)
+		align = std::max(align, field.natural_align);
+
+	return align;
+}
+
+/*
+ * A `soa<T>` stores every field of `T` in an array of its own, so a loop over one field
+ * only pulls that field into the cache and can read and write it with vector instructions.
+ * `xs[i].field` is the i-th element of the field's array, there is no `T` in memory.
+ * Everything is one allocation: the header, then the arrays, each on a `soa_align`
+ * boundary. The header has an alias scope of its own that the arrays never write to, so
+ * loads from it are hoisted out of loops even when the loop writes to the arrays. They
+ * aren't `!invariant.load`, the function allocating the `soa<T>` stores to it.
+ */
+// Token Patterns: soa<Type>(count)
+llvm::Value *Codegen::soa_alloc(CallExprAst *expr)
+{
+	if (expr->type_args.size() != 1 || expr->args.size() != 1)
+		return nullptr;
+
+	auto layout = this->layout(this->type(expr->type_args[0].get()));
+	if (!layout)
+		return nullptr;
+
+	auto i64_type = this->builder.getInt64Ty();
+	auto count = this->operand(expr->args[0].get(), i64_type);
+	if (!count || !count->getType()->isIntegerTy() || !(count = this->convert(count, i64_type)))
+		return nullptr;
+
+	auto header = this->soa_header(layout);
+	auto align = this->soa_align(layout);
+	uint64_t element_size = 0;
+	for (auto &field : layout->fields)
+		element_size += field.size;
+
+	// Negative counts and sizes that would wrap around trap instead of getting a short allocation
+	auto limit = (uint64_t(1) << 48) / std::max(element_size, uint64_t(1));
+	this->trap_if(this->builder.CreateICmpUGT(count, this->builder.getInt64(limit)));
+
+	auto mask = this->builder.getInt64(align - 1);
+	llvm::Value *size = this->builder.getInt64(llvm::alignTo(this->module.getDataLayout().getTypeAllocSize(header), align));
+	std::vector<llvm::Value *> offsets;
+	for (auto &field : layout->fields) {
+		offsets.push_back(size);
+		size = this->builder.CreateAdd(size, this->builder.CreateMul(count, this->builder.getInt64(field.size)));
+		size = this->builder.CreateAnd(this->builder.CreateAdd(size, mask), this->builder.CreateNot(mask));
+	}
+
+	auto aligned_alloc_func = this->module.getOrInsertFunction("aligned_alloc", this->builder.getPtrTy(), i64_type, i64_type);
+	auto handle = this->builder.CreateCall(aligned_alloc_func, { this->builder.getInt64(align), size }, "soa");
+	this->builder.CreateAlignedStore(count, this->builder.CreateStructGEP(header, handle, 0), llvm::Align(8));
+	for (size_t i = 0; i < offsets.size(); ++i) {
+		auto array = this->builder.CreateGEP(this->builder.getInt8Ty(), handle, offsets[i], layout->fields[i].name);
+		this->builder.CreateAlignedStore(array, this->builder.CreateStructGEP(header, handle, i + 1), llvm::Align(8));
+	}
+
+	return handle;
+}
+
+// Token Patterns: len(soa)
+llvm::Value *Codegen::soa_len(CallExprAst *expr)
+{
+	auto header = this->soa_header(this->elements(expr->args[0].get()));
+	auto handle = this->eval(expr->args[0].get());
+	if (!handle)
+		return nullptr;
+
+	auto len = this->builder.CreateAlignedLoad(this->builder.getInt64Ty(), this->builder.CreateStructGEP(header, handle, 0),
+	                                           llvm::Align(8), "len");
+	len->setAAMetadata(this->soa_aliasing(this->elements(expr->args[0].get()), 0));
+	return len;
+}
+
+// The alias scope of one field's array, or of the header for `position == 0`, and the scopes
+// of all the others, which it never overlaps, of this or any other `soa<T>`
+llvm::AAMDNodes Codegen::soa_aliasing(StructLayout *layout, size_t position)
+{
+	auto &scopes = this->soa_scopes[layout];
+	if (scopes.empty()) {
+		llvm::MDBuilder md(this->context);
+		auto domain = md.createAnonymousAliasScopeDomain("soa<" + layout->name + ">");
+		scopes.push_back(md.createAnonymousAliasScope(domain, "header"));
+		for (auto &field : layout->fields)
+			scopes.push_back(md.createAnonymousAliasScope(domain, field.name));
+	}
+
+	std::vector<llvm::Metadata *> others;
+	for (size_t i = 0; i < scopes.size(); ++i) {
+		if (i != position)
+			others.push_back(scopes[i]);
+	}
+	llvm::AAMDNodes aliasing;
+	aliasing.Scope = llvm::MDNode::get(this->context, { scopes[position] });
+	aliasing.NoAlias = llvm::MDNode::get(this->context, others);
+	return aliasing;
+}
+
+// The address of `xs[i].field`, the i-th element of the field's array
+llvm::Value *Codegen::soa_element(ArrayIndexExprAst *expr, StructLayout *layout, bool write, FieldAccess &access)
+{
+	auto field = access.field;
+	if (write && this->is_readonly(expr->var.get()))
+		return nullptr;
+
+	// Like the fields of a struct binding, the elements are only written through a `mut` binding
+	if (write) {
+		auto binding = this->variables.find(expr->var->name);
+		if (binding == this->variables.end() || !binding->second.mut)
+			return nullptr;
+	}
+
+	auto handle = this->eval(expr->var.get());
+	auto index = handle ? this->eval(expr->index.get()) : nullptr;
+	if (!index || !index->getType()->isIntegerTy())
+		return nullptr;
+
+	auto header = this->soa_header(layout);
+	auto position = static_cast<unsigned int>(field - layout->fields.data());
+	auto slot = this->builder.CreateStructGEP(header, handle, position + 1);
+	auto array = this->builder.CreateAlignedLoad(this->builder.getPtrTy(), slot, llvm::Align(8), field->name + ".array");
+	auto align = llvm::ConstantAsMetadata::get(this->builder.getInt64(this->soa_align(layout)));
+	array->setAAMetadata(this->soa_aliasing(layout, 0));
+	array->setMetadata(llvm::LLVMContext::MD_nonnull, llvm::MDNode::get(this->context, {}));
+	array->setMetadata(llvm::LLVMContext::MD_align, llvm::MDNode::get(this->context, { align }));
+
+	access.align = field->natural_align;
+	access.aliasing = this->soa_aliasing(layout, position + 1);
+
+	index = this->convert(index, this->builder.getInt64Ty());
+	return this->builder.CreateGEP(field->type, array, index, field->name);
+}
+
+llvm::Value *Codegen::eval(NumberExprAst *expr)
+{
+	llvm::Type *type;
+
+	// TODO: Type inference or receive type in param
+	if (expr->number.find('.') != std::string::npos)
+		type = builder.getDoubleTy();
+	else
+		type = builder.getInt32Ty();
+
+	return this->number(expr, type);
+}
+
+llvm::Constant *Codegen::number(NumberExprAst *expr, llvm::Type *type)
+{
+	llvm::Constant *value;
+	if (type->isIntegerTy()) {
+		value = llvm::Constant::getIntegerValue(type, llvm::APInt(type->getIntegerBitWidth(), expr->number, 10));
+	} else {
+		value = llvm::ConstantFP::get(type, expr->number);
+	}
+
+	return value;
+}
+
+// Evaluates an expression where a value of type `hint` is expected, number literals are created with that type
+llvm::Value *Codegen::operand(ExprAst *expr, llvm::Type *hint)
+{
+	if (auto comptime = dynamic_cast<ComptimeExprAst *>(expr); comptime != nullptr)
+		return this->eval(comptime, hint);
+
+	auto number = dynamic_cast<NumberExprAst *>(expr);
+	if (number && hint && (hint->isFloatingPointTy() || (hint->isIntegerTy() && number->number.find('.') == std::string::npos)))
+		return this->number(number, hint);
+
+	return this->eval(expr);
+}
+
+// Implicit conversions between the number types, `nullptr` if there is none
+llvm::Value *Codegen::convert(llvm::Value *value, llvm::Type *type)
+{
+	auto from = value->getType();
+	if (from == type)
+		return value;
+
+	bool is_bool = from->isIntegerTy(1);
+	if (from->isIntegerTy() && type->isIntegerTy())
+		return is_bool ? this->builder.CreateZExt(value, type) : this->builder.CreateSExtOrTrunc(value, type);
+	if (from->isIntegerTy() && type->isFloatingPointTy())
+		return is_bool ? this->builder.CreateUIToFP(value, type) : this->builder.CreateSIToFP(value, type);
+	if (from->isFloatingPointTy() && type->isIntegerTy())
+		return this->builder.CreateFPToSI(value, type);
+	if (from->isFloatingPointTy() && type->isFloatingPointTy())
+		return this->builder.CreateFPCast(value, type);
+
+	return nullptr;
+}
+
+// The type both sides of an operation are converted to: the wider one, floats win over integers
+llvm::Type *Codegen::common_type(llvm::Type *a, llvm::Type *b)
+{
+	if (a == b)
+		return a;
+
+	if (a->isIntegerTy() && b->isIntegerTy())
+		return a->getIntegerBitWidth() >= b->getIntegerBitWidth() ? a : b;
+	if (a->isFloatingPointTy() && b->isFloatingPointTy())
+		return a->getPrimitiveSizeInBits() >= b->getPrimitiveSizeInBits() ? a : b;
+	if (a->isFloatingPointTy() && b->isIntegerTy())
+		return a;
+	if (a->isIntegerTy() && b->isFloatingPointTy())
+		return b;
+
+	return nullptr;
+}
+
+// Conditions are true when not zero
+llvm::Value *Codegen::condition(llvm::Value *value)
+{
+	auto type = value->getType();
+	if (type->isIntegerTy(1))
+		return value;
+	if (type->isIntegerTy() || type->isPointerTy())
+		return this->builder.CreateICmpNE(value, llvm::Constant::getNullValue(type));
+	if (type->isFloatingPointTy())
+		return this->builder.CreateFCmpUNE(value, llvm::ConstantFP::get(type, 0.0));
+
+	return nullptr;
+}
+
+// Returning a reference counted binding hands a new reference to the caller, the binding
+// itself is released on the way out
+llvm::Value *Codegen::owned(ExprAst *expr, llvm::Value *value)
+{
+	auto rc = this->rc_kind(expr);
+	if (rc != RcKind::None && dynamic_cast<VariableExprAst *>(expr) != nullptr)
+		return this->builder.CreateCall(this->rc_runtime(rc, RcOp::Retain), { value });
+
+	return value;
+}
+
+llvm::Value *Codegen::eval(BinaryOpExprAst *expr)
+{
+	// Number literals take the type of the other side
+	llvm::Value *left, *right;
+	if (dynamic_cast<NumberExprAst *>(expr->left.get()) && !dynamic_cast<NumberExprAst *>(expr->right.get())) {
+		if (!(right = this->eval(expr->right.get())))
+			return nullptr;
+		left = this->operand(expr->left.get(), right->getType());
+	} else {
+		if (!(left = this->eval(expr->left.get())))
+			return nullptr;
+		right = this->operand(expr->right.get(), left->getType());
+	}
+	if (!right)
+		return nullptr;
+
+	auto &op = expr->op;
+	auto type = this->common_type(left->getType(), right->getType());
+	if (!type && left->getType()->isPointerTy() && right->getType()->isPointerTy() && (op == "==" || op == "!="))
+		type = left->getType();
+	if (!type || !(left = this->convert(left, type)) || !(right = this->convert(right, type)))
+		return nullptr;
+
+	static const std::map<std::string, std::pair<llvm::Instruction::BinaryOps, llvm::Instruction::BinaryOps>> arithmetic = {
+		{ "+", { llvm::Instruction::Add, llvm::Instruction::FAdd } },
+		{ "-", { llvm::Instruction::Sub, llvm::Instruction::FSub } },
+		{ "*", { llvm::Instruction::Mul, llvm::Instruction::FMul } },
+		{ "/", { llvm::Instruction::SDiv, llvm::Instruction::FDiv } },
+	};
+	static const std::map<std::string, std::pair<llvm::CmpInst::Predicate, llvm::CmpInst::Predicate>> comparisons = {
+		{ "==", { llvm::CmpInst::ICMP_EQ, llvm::CmpInst::FCMP_OEQ } },
+		{ "!=", { llvm::CmpInst::ICMP_NE, llvm::CmpInst::FCMP_UNE } },
+		{ "<", { llvm::CmpInst::ICMP_SLT, llvm::CmpInst::FCMP_OLT } },
+		{ ">", { llvm::CmpInst::ICMP_SGT, llvm::CmpInst::FCMP_OGT } },
+		{ "<=", { llvm::CmpInst::ICMP_SLE, llvm::CmpInst::FCMP_OLE } },
+		{ ">=", { llvm::CmpInst::ICMP_SGE, llvm::CmpInst::FCMP_OGE } },
+	};
+
+	bool fp = type->isFloatingPointTy();
+	if (auto cmp = comparisons.find(op); cmp != comparisons.end())
+		return this->builder.CreateCmp(fp ? cmp->second.second : cmp->second.first, left, right);
+
+	// The wrapping operators always wrap, whatever `-foverflow` says
+	bool wrapping = op.size() == 2 && op[1] == '%';
+	auto arith = arithmetic.find(wrapping ? op.substr(0, 1) : op);
+	if (arith == arithmetic.end())
+		return nullptr;
+
+	if (fp && !wrapping)
+		return this->builder.CreateBinOp(arith->second.second, left, right);
+	if (type->isIntegerTy())
+		return this->int_arithmetic(arith->second.first, left, right, wrapping);
+
+	// Pointers can only be compared
+	return nullptr;
+}
+
+llvm::Value *Codegen::int_arithmetic(llvm::Instruction::BinaryOps op, llvm::Value *left, llvm::Value *right, bool wrapping)
+{
+	auto mode = wrapping ? OverflowMode::Wrap : this->options.overflow;
+
+	if (mode == OverflowMode::Trap && op == llvm::Instruction::SDiv) {
+		// Division by zero and the one quotient that doesn't fit, `INT_MIN / -1`
+		auto type = llvm::cast<llvm::IntegerType>(left->getType());
+		auto min = llvm::ConstantInt::get(type, llvm::APInt::getSignedMinValue(type->getBitWidth()));
+		auto by_zero = this->builder.CreateICmpEQ(right, llvm::ConstantInt::get(type, 0));
+		auto too_big = this->builder.CreateAnd(this->builder.CreateICmpEQ(left, min),
+		                                       this->builder.CreateICmpEQ(right, llvm::ConstantInt::getSigned(type, -1)));
+		this->trap_if(this->builder.CreateOr(by_zero, too_big));
+	} else if (mode == OverflowMode::Trap) {
+		auto id = op == llvm::Instruction::Add ? llvm::Intrinsic::sadd_with_overflow :
+		          op == llvm::Instruction::Sub ? llvm::Intrinsic::ssub_with_overflow :
+		                                         llvm::Intrinsic::smul_with_overflow;
+		auto result = this->builder.CreateBinaryIntrinsic(id, left, right);
+		this->trap_if(this->builder.CreateExtractValue(result, 1));
+		return this->builder.CreateExtractValue(result, 0);
+	}
+
+	auto result = this->builder.CreateBinOp(op, left, right);
+	if (auto inst = llvm::dyn_cast<llvm::BinaryOperator>(result); inst && mode == OverflowMode::AssumeNone &&
+	    op != llvm::Instruction::SDiv)
+		inst->setHasNoSignedWrap(true);
+
+	return result;
+}
+
+// Stops the program right here if `condition` holds, which is expected to never happen
+void Codegen::trap_if(llvm::Value *condition)
+{
+	auto function = this->builder.GetInsertBlock()->getParent();
+	auto trap = llvm::BasicBlock::Create(this->context, "overflow", function);
+	auto cont = llvm::BasicBlock::Create(this->context, "no_overflow", function);
+	auto weights = llvm::MDBuilder(this->context).createBranchWeights(1, 1 << 20);
+	this->builder.CreateCondBr(condition, trap, cont, weights);
+
+	this->builder.SetInsertPoint(trap);
+	this->builder.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+	this->builder.CreateUnreachable();
+
+	this->builder.SetInsertPoint(cont);
+}
+
+llvm::Value *Codegen::eval(ArrayIndexExprAst *expr)
+{
+	if (this->variables.find(expr->var->name) == this->variables.end())
+		return nullptr;
+
+	// There is no `T` in a `soa<T>`, only its fields can be read
+	if (this->variables[expr->var->name].elements)
+		return nullptr;
+
+	// Tables computed at compile time
+	if (auto table = llvm::dyn_cast<llvm::ArrayType>(this->variables[expr->var->name].type); table != nullptr) {
+		auto index = this->eval(expr->index.get());
+		if (!index || !index->getType()->isIntegerTy())
+			return nullptr;
+
+		auto global = this->variables[expr->var->name].value;
+		auto ptr = this->builder.CreateInBoundsGEP(table, global, { this->builder.getInt64(0), index });
+		auto load = this->builder.CreateLoad(table->getElementType(), ptr);
+		if (llvm::cast<llvm::GlobalVariable>(global)->isConstant())
+			load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(this->context, {}));
+		return load;
+	}
+
+	auto arr = this->variables[expr->var->name].value;
+	if (!arr)
+		return nullptr;
+
+	auto loaded_arr = this->builder.CreateLoad(builder.getPtrTy(), arr, "__array_loaded__");
+
+	auto index = this->eval(expr->index.get());
+	if (!index)
+		return nullptr;
+
+	auto deref = this->builder.getInt32(0);
+	auto type = llvm::ArrayType::get(this->builder.getPtrTy(), 64); // TODO: Just don't do this. This is such a hack
+	auto bigtype = llvm::ArrayType::get(type, 64); // TODO: Just don't do this. This is such a hack
+	auto ptr = this->builder.CreateGEP(bigtype, loaded_arr, { deref,  index, index }, "__array_deref__");
+	auto ptr_load = this->builder.CreateLoad(builder.getPtrTy(), ptr, "__array_value__");
+
+	return ptr_load;
+}
+
+bool Codegen::include(ExprAst *expr)
+{
+	if (auto decl_expr = dynamic_cast<DeclarationExprAst *>(expr); decl_expr != nullptr)
+		return this->include(decl_expr);
+
+	if (auto call_expr = dynamic_cast<CallExprAst *>(expr); call_expr != nullptr)
+		return this->include(call_expr);
+
+	if (auto block_expr = dynamic_cast<CodeblockExprAst *>(expr); block_expr != nullptr)
+		return this->include(block_expr);
+
+	if (auto arena_expr = dynamic_cast<ArenaExprAst *>(expr); arena_expr != nullptr)
+		return this->include(arena_expr);
+
+	if (auto defer_expr = dynamic_cast<DeferExprAst *>(expr); defer_expr != nullptr)
+		return this->include(defer_expr);
+
+	if (auto return_expr = dynamic_cast<ReturnExprAst *>(expr); return_expr != nullptr)
+		return this->include(return_expr);
+
+	if (auto become_expr = dynamic_cast<BecomeExprAst *>(expr); become_expr != nullptr)
+		return this->include(become_expr);
+
+	if (auto if_expr = dynamic_cast<IfExprAst *>(expr); if_expr != nullptr)
+		return this->include(if_expr);
+
+	if (auto binop_expr = dynamic_cast<BinaryOpExprAst *>(expr); binop_expr != nullptr)
+		return this->eval(binop_expr) != nullptr;
+
+	if (auto assign_expr = dynamic_cast<AssignExprAst *>(expr); assign_expr != nullptr)
+		return this->include(assign_expr);
+
+	if (auto member_expr = dynamic_cast<MemberExprAst *>(expr); member_expr != nullptr)
+		return this->eval(member_expr) != nullptr;
+
+	if (auto extern_expr = dynamic_cast<ExternExprAst *>(expr); extern_expr != nullptr)
+		return this->include(extern_expr);
+
+	return false;
+}
+
+void Codegen::declare(std::string name, Variable var)
+{
+	if (!this->scopes.empty()) {
+		auto &shadowed = this->scopes.back().shadowed;
+		if (shadowed.find(name) == shadowed.end()) {
+			auto prev = this->variables.find(name);
+			shadowed[name] = prev != this->variables.end() ? std::optional<Variable>(prev->second) : std::nullopt;
+		}
+
+		if (var.rc != RcKind::None) {
+			this->scopes.back().cleanups.push_back(Cleanup { [this, var]() {
+				auto value = this->builder.CreateLoad(var.type, var.value);
+				this->builder.CreateCall(this->rc_runtime(var.rc, RcOp::Release), { value });
+				return true;
+			}, 2 });
+		}
+	}
+
+	this->variables[name] = var;
+}
+
+void Codegen::push_scope()
+{
+	this->scopes.push_back(Scope {});
+}
+
+bool Codegen::pop_scope()
+{
+	// Falling through only leaves a single scope, its cleanups always go inline
+	if (!this->is_terminated() && !this->emit_cleanups(this->scopes.back(), this->scopes.back().cleanups.size()))
+		return false;
+
+	auto scope = std::move(this->scopes.back());
+	this->scopes.pop_back();
+
+	for (auto &[name, prev] : scope.shadowed) {
+		if (prev)
+			this->variables[name] = *prev;
+		else
+			this->variables.erase(name);
+	}
+
+	return true;
+}
+
+/*
+ * Leaves the scopes [depth, from) and continues at `dest`, or returns from the function
+ * if `dest` is `nullptr`. There are no runtime cleanup stacks: the cleanups registered
+ * so far are expanded right here, innermost first.
+ *
+ * Expanding big cleanups at every exit bloats the code, so scopes whose cleanups cost
+ * more than `cleanup_inline_threshold` instructions get a shared cleanup block per
+ * destination that all such exits branch to instead. A returned `value` is passed to
+ * those through the function's return slot. Fails if a cleanup can't be generated.
+ */
+bool Codegen::exit_scopes(size_t from, size_t depth, llvm::BasicBlock *dest, llvm::Value *value)
+{
+	for (size_t i = from; i-- > depth;) {
+		auto &scope = this->scopes[i];
+		auto count = scope.cleanups.size();
+		if (count == 0)
+			continue;
+
+		if (this->cleanup_cost(scope, count) <= this->options.cleanup_inline_threshold) {
+			if (!this->emit_cleanups(scope, count))
+				return false;
+			continue;
+		}
+
+		auto key = std::make_tuple(count, depth, dest);
+		auto shared = scope.exits.find(key);
+		if (shared == scope.exits.end()) {
+			auto function = this->builder.GetInsertBlock()->getParent();
+			auto block = llvm::BasicBlock::Create(this->context, "cleanup", function);
+			auto insert_point = this->builder.saveIP();
+			this->builder.SetInsertPoint(block);
+			bool ok = this->emit_cleanups(scope, count) && this->exit_scopes(i, depth, dest);
+			this->builder.restoreIP(insert_point);
+			if (!ok)
+				return false;
+			shared = scope.exits.insert({ key, block }).first;
+		}
+
+		if (!dest && value)
+			this->builder.CreateStore(value, this->return_slot);
+		this->builder.CreateBr(shared->second);
+		return true;
+	}
+
+	if (dest)
+		this->builder.CreateBr(dest);
+	else if (value)
+		this->builder.CreateRet(value);
+	else if (this->return_slot)
+		this->builder.CreateRet(this->builder.CreateLoad(this->return_slot->getAllocatedType(), this->return_slot));
+	else
+		this->builder.CreateRetVoid();
+	return true;
+}
+
+bool Codegen::emit_cleanups(Scope &scope, size_t count)
+{
+	for (size_t i = count; i-- > 0;) {
+		if (!scope.cleanups[i].emit())
+			return false;
+	}
+	return true;
+}
+
+size_t Codegen::cleanup_cost(Scope &scope, size_t count)
+{
+	size_t cost = 0;
+	for (size_t i = 0; i < count; ++i)
+		cost += scope.cleanups[i].cost;
+	return cost;
+}
+
+bool Codegen::is_terminated()
+{
+	auto block = this->builder.GetInsertBlock();
+	return block && block->getTerminator() != nullptr;
+}
+
+void Codegen::optimize()
+{
+	// The debug info has to be complete before any pass looks at it
+	if (this->debug_info)
+		this->debug_info->finalize();
+
+	llvm::LoopAnalysisManager lam;
+	llvm::FunctionAnalysisManager fam;
+	llvm::CGSCCAnalysisManager cgam;
+	llvm::ModuleAnalysisManager mam;
+
+	// The pipelines insert the counters or read them back into branch weights and function entry counts,
+	// which the inliner, block placement and the section prefixes of hot and cold functions go by
+	std::optional<llvm::PGOOptions> pgo;
+	if (!this->options.profile_generate.empty())
+		pgo = llvm::PGOOptions(this->options.profile_generate, "", "", "", llvm::vfs::getRealFileSystem(),
+		                       llvm::PGOOptions::IRInstr);
+	else if (!this->options.profile_use.empty())
+		pgo = llvm::PGOOptions(this->options.profile_use, "", "", "", llvm::vfs::getRealFileSystem(),
+		                       llvm::PGOOptions::IRUse);
+
+	// For `-ftime-report`, only the passes doing the work are summed up by name. The ones running
+	// other passes (managers, adaptors) still show up in the trace, around the passes they ran.
+	struct RunningPass {
+		std::string name;
+		PhaseSample start;
+		bool parent = false;
+	};
+	std::vector<RunningPass> running;
+	llvm::PassInstrumentationCallbacks pic;
+	if (auto report = this->options.time_report; report != nullptr) {
+		pic.registerBeforeNonSkippedPassCallback([&running](llvm::StringRef pass, llvm::Any) {
+			if (!running.empty())
+				running.back().parent = true;
+			running.push_back({ pass.str(), PhaseSample::now() });
+		});
+
+		auto after = [&running, report, file = this->module.getSourceFileName()](llvm::StringRef) {
+			PhaseSpan span;
+			span.category = running.back().parent ? "passes" : "pass";
+			span.name = running.back().name;
+			span.file = file;
+			span.start_ns = running.back().start.wall_ns;
+			span.cost = PhaseSample::now() - running.back().start;
+			report->record(std::move(span));
+			running.pop_back();
+		};
+		pic.registerAfterPassCallback([after](llvm::StringRef pass, llvm::Any, const llvm::PreservedAnalyses &) {
+			after(pass);
+		});
+		pic.registerAfterPassInvalidatedCallback([after](llvm::StringRef pass, const llvm::PreservedAnalyses &) {
+			after(pass);
+		});
+	}
+	llvm::PassBuilder pb(this->target(), llvm::PipelineTuningOptions(), pgo, &pic);
+
+	pb.registerModuleAnalyses(mam);
+	pb.registerCGSCCAnalyses(cgam);
+	pb.registerFunctionAnalyses(fam);
+	pb.registerLoopAnalyses(lam);
+	pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+	// The inferred attributes are part of the emitted IR at every level
+	if (this->options.opt_level == 0) {
+		llvm::ModulePassManager mpm;
+		mpm.addPass(llvm::InferFunctionAttrsPass());
+		mpm.addPass(AttributeInferencePass());
+		// Counting works without optimizations, using the counts doesn't
+		if (!this->options.profile_generate.empty())
+			mpm.addPass(pb.buildO0DefaultPipeline(llvm::OptimizationLevel::O0));
+		mpm.run(this->module, mam);
+		this->instrument();
+		return;
+	}
+
+	// The locals have to be promoted first, so the reference count calls see the values directly.
+	// Attributes are inferred on the result, the rest of the pipeline builds on them.
+	pb.registerPipelineEarlySimplificationEPCallback([](llvm::ModulePassManager &mpm, llvm::OptimizationLevel) {
+		mpm.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::PromotePass()));
+		mpm.addPass(RefcountOptPass());
+		mpm.addPass(HeapToStackPass());
+		mpm.addPass(llvm::InferFunctionAttrsPass());
+		mpm.addPass(AttributeInferencePass(true));
+	});
+
+	// Cold regions the profile never saw run are outlined, so the hot code is packed tighter.
+	// Not before `-flto` though, it would outline code the cross-file inlining still has to see.
+	if (!this->options.profile_use.empty() && this->options.lto == LtoMode::None) {
+		pb.registerOptimizerLastEPCallback([](llvm::ModulePassManager &mpm, llvm::OptimizationLevel) {
+			mpm.addPass(llvm::HotColdSplittingPass());
+		});
+	}
+
+	static const llvm::OptimizationLevel levels[] = {
+		llvm::OptimizationLevel::O0,
+		llvm::OptimizationLevel::O1,
+		llvm::OptimizationLevel::O2,
+		llvm::OptimizationLevel::O3,
+	};
+	// With `-flto` the rest of the optimization happens when the files are linked
+	auto level = levels[std::min(this->options.opt_level, 3u)];
+	llvm::ModulePassManager mpm;
+	if (this->options.lto == LtoMode::Full)
+		mpm = pb.buildLTOPreLinkDefaultPipeline(level);
+	else if (this->options.lto == LtoMode::Thin)
+		mpm = pb.buildThinLTOPreLinkDefaultPipeline(level);
+	else
+		mpm = pb.buildPerModuleDefaultPipeline(level);
+	mpm.run(this->module, mam);
+	this->instrument();
+}
+
+/*
+ * `-finstrument`, after the optimizations: the functions that were inlined into their callers
+ * are part of their time, like they are in the machine code, and the hooks don't get in the way
+ * of the optimizer. What is left of the defined functions calls the runtime (runtime/profile.c)
+ * on entry and before every return, with a frame on its stack. A `musttail` call has to stay
+ * right before its `ret`, so the function is left before it, the callee takes over its frame.
+ *
+ * The names go into a table the module registers from a constructor, which gets the first id
+ * of the module back, so the ids of several files don't collide.
+ */
+void Codegen::instrument()
+{
+	std::vector<llvm::Function *> functions;
+	for (auto &handle : this->instrumented) {
+		if (auto function = llvm::dyn_cast_or_null<llvm::Function>(handle); function && !function->isDeclaration())
+			functions.push_back(function);
+	}
+	this->instrumented.clear();
+	if (functions.empty())
+		return;
+
+	auto ptr_type = this->builder.getPtrTy();
+	auto i64_type = this->builder.getInt64Ty();
+	auto void_type = this->builder.getVoidTy();
+	auto frame_type = llvm::StructType::get(this->context, { i64_type, i64_type, i64_type, ptr_type });
+	auto enter = this->module.getOrInsertFunction("__1337_profile_enter",
+	                                              llvm::FunctionType::get(void_type, { ptr_type, i64_type }, false));
+	auto exit = this->module.getOrInsertFunction("__1337_profile_exit",
+	                                             llvm::FunctionType::get(void_type, { ptr_type }, false));
+	auto base = new llvm::GlobalVariable(this->module, i64_type, false, llvm::GlobalValue::InternalLinkage,
+	                                     llvm::ConstantInt::get(i64_type, 0), "__1337_profile_base");
+
+	std::vector<llvm::Constant *> names;
+	for (size_t id = 0; id < functions.size(); ++id) {
+		auto function = functions[id];
+		names.push_back(this->builder.CreateGlobalStringPtr(function->getName(), "__1337_profile_name", 0, &this->module));
+
+		auto &entry = function->getEntryBlock();
+		llvm::IRBuilder<> prologue(&entry, entry.getFirstNonPHIOrDbgOrAlloca());
+		auto frame = prologue.CreateAlloca(frame_type, nullptr, "profile.frame");
+		auto index = prologue.CreateAdd(prologue.CreateLoad(i64_type, base), prologue.getInt64(id));
+		prologue.CreateCall(enter, { frame, index });
+
+		for (auto &block : *function) {
+			auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+			if (ret == nullptr)
+				continue;
+			llvm::Instruction *before = ret;
+			if (auto call = llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode()); call && call->isMustTailCall())
+				before = call;
+			llvm::IRBuilder<>(before).CreateCall(exit, { frame });
+		}
+	}
+
+	auto table_type = llvm::ArrayType::get(ptr_type, names.size());
+	auto table = new llvm::GlobalVariable(this->module, table_type, true, llvm::GlobalValue::PrivateLinkage,
+	                                      llvm::ConstantArray::get(table_type, names), "__1337_profile_names");
+	auto registration = llvm::Function::Create(llvm::FunctionType::get(void_type, false), llvm::Function::InternalLinkage,
+	                                           "__1337_profile_init", this->module);
+	llvm::IRBuilder<> init(llvm::BasicBlock::Create(this->context, "entry", registration));
+	auto register_type = llvm::FunctionType::get(void_type, { ptr_type, i64_type, ptr_type }, false);
+	init.CreateCall(this->module.getOrInsertFunction("__1337_profile_register", register_type),
+	                { table, init.getInt64(names.size()), base });
+	init.CreateRetVoid();
+	llvm::appendToGlobalCtors(this->module, registration, 0);
+}
+
+RcKind Codegen::rc_kind(TypeExprAst *expr)
+{
+	if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr->type.get()); basic != nullptr) {
+		if (auto bound = this->type_bindings.find(basic->type); bound != this->type_bindings.end())
+			return this->rc_kind(bound->second);
+	}
+
+	if (auto generic = dynamic_cast<GenericTypeExprAst *>(expr->type.get()); generic != nullptr) {
+		if (generic->name == "rc")
+			return RcKind::Rc;
+		if (generic->name == "arc")
+			return RcKind::Arc;
+	}
+
+	return RcKind::None;
+}
+
+RcKind Codegen::rc_kind(ExprAst *expr)
+{
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr) {
+		auto it = this->variables.find(var->name);
+		return it != this->variables.end() ? it->second.rc : RcKind::None;
+	}
+
+	if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr) {
+		if (call->function == "rcalloc")
+			return RcKind::Rc;
+		if (call->function == "arcalloc")
+			return RcKind::Arc;
+		if (auto function = this->callee(call); function != nullptr) {
+			auto it = this->rc_returns.find(function);
+			return it != this->rc_returns.end() ? it->second : RcKind::None;
+		}
+	}
+
+	return RcKind::None;
+}
+
+// Token Patterns: alloc<Type>()
+//                 alloc<Type>(arena)
+llvm::Value *Codegen::alloc(CallExprAst *expr)
+{
+	if (expr->type_args.size() != 1 || expr->args.size() > 1)
+		return nullptr;
+
+	auto type = this->type(expr->type_args[0].get());
+	if (!type)
+		return nullptr;
+
+	auto arena = this->alloc_arena(expr);
+	if (!arena && !expr->args.empty())
+		return nullptr;
+
+	auto allocate = [&](llvm::Type *type, uint64_t align) -> llvm::Value * {
+		auto size = llvm::ConstantExpr::getSizeOf(type);
+		if (arena) {
+			auto align_value = align ? this->builder.getInt64(align) : llvm::ConstantExpr::getAlignOf(type);
+			return this->builder.CreateCall(this->arena_runtime("__1337_arena_alloc"), { arena, size, align_value });
+		}
+
+		// `malloc` is good for 16 bytes, the sizes of structs are multiples of their alignment
+		if (align > 16) {
+			auto aligned_alloc_func = this->module.getOrInsertFunction("aligned_alloc", this->builder.getPtrTy(),
+			                                                           this->builder.getInt64Ty(), this->builder.getInt64Ty());
+			return this->builder.CreateCall(aligned_alloc_func, { this->builder.getInt64(align), size });
+		}
+
+		auto malloc_func = this->module.getOrInsertFunction("malloc", this->builder.getPtrTy(), this->builder.getInt64Ty());
+		return this->builder.CreateCall(malloc_func, { size });
+	};
+
+	auto layout = this->layout(type);
+	auto object = allocate(type, layout ? layout->hot.align : 0);
+
+	// The cold part of a struct is a second allocation from the same place
+	if (layout && layout->cold.type) {
+		auto cold = allocate(layout->cold.type, layout->cold.align);
+		auto cold_ptr = this->builder.CreateStructGEP(layout->hot.type, object, layout->cold_index);
+		this->builder.CreateAlignedStore(cold, cold_ptr, llvm::commonAlignment(llvm::Align(layout->hot.align), layout->cold_offset));
+	}
+
+	return object;
+}
+
+// Token Patterns: rcalloc<Type>() / arcalloc<Type>()
+llvm::Value *Codegen::rc_alloc(CallExprAst *expr)
+{
+	if (expr->type_args.size() != 1 || !expr->args.empty())
+		return nullptr;
+
+	auto type = this->type(expr->type_args[0].get());
+	if (!type)
+		return nullptr;
+
+	// The runtime frees an object in one piece, and its payload is only aligned for 8 bytes
+	if (auto layout = this->layout(type); layout && (layout->cold.type || layout->hot.align > 8))
+		return nullptr;
+
+	auto kind = expr->function == "arcalloc" ? RcKind::Arc : RcKind::Rc;
+	auto size = llvm::ConstantExpr::getSizeOf(type);
+
+	return this->builder.CreateCall(this->rc_runtime(kind, RcOp::Alloc), { size });
+}
+
+llvm::Function *Codegen::rc_runtime(RcKind kind, RcOp op)
+{
+	if (auto function = this->module.getFunction(RcRuntime::name(kind, op)); function != nullptr)
+		return function;
+
+	// Both flavors are always emitted together, the optimizer may turn one into the other
+	auto builder = llvm::IRBuilder<>(this->context);
+	auto ptr_type = builder.getPtrTy();
+	auto i64_type = builder.getInt64Ty();
+	auto calloc_func = this->module.getOrInsertFunction("calloc", ptr_type, i64_type, i64_type);
+	auto free_func = this->module.getOrInsertFunction("free", builder.getVoidTy(), ptr_type);
+	auto create = [&](RcKind kind, RcOp op, llvm::FunctionType *type) {
+		auto function = llvm::Function::Create(type, llvm::Function::LinkOnceODRLinkage, RcRuntime::name(kind, op), this->module);
+		builder.SetInsertPoint(llvm::BasicBlock::Create(this->context, "entry", function));
+		return function;
+	};
+
+	for (auto kind : { RcKind::Rc, RcKind::Arc }) {
+		bool atomic = kind == RcKind::Arc;
+
+		// The counter starts at 1, the reference of the allocating binding
+		auto alloc = create(kind, RcOp::Alloc, llvm::FunctionType::get(ptr_type, { i64_type }, false));
+		auto total = builder.CreateAdd(alloc->getArg(0), builder.getInt64(8));
+		auto object = builder.CreateCall(calloc_func, { builder.getInt64(1), total });
+		builder.CreateStore(builder.getInt64(1), object);
+		builder.CreateRet(builder.CreateConstGEP1_64(builder.getInt8Ty(), object, 8));
+
+		// Returns the object itself, so every new reference is its own value
+		auto retain = create(kind, RcOp::Retain, llvm::FunctionType::get(ptr_type, { ptr_type }, false));
+		auto retain_inc = llvm::BasicBlock::Create(this->context, "inc", retain);
+		auto retain_done = llvm::BasicBlock::Create(this->context, "done", retain);
+		builder.CreateCondBr(builder.CreateIsNull(retain->getArg(0)), retain_done, retain_inc);
+		builder.SetInsertPoint(retain_inc);
+		auto counter = builder.CreateConstGEP1_64(builder.getInt8Ty(), retain->getArg(0), -8);
+		if (atomic) {
+			builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, builder.getInt64(1),
+			                        llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+		} else {
+			auto count = builder.CreateLoad(i64_type, counter);
+			builder.CreateStore(builder.CreateAdd(count, builder.getInt64(1)), counter);
+		}
+		builder.CreateBr(retain_done);
+		builder.SetInsertPoint(retain_done);
+		builder.CreateRet(retain->getArg(0));
+
+		// Frees the object once the last reference is gone
+		auto release = create(kind, RcOp::Release, llvm::FunctionType::get(builder.getVoidTy(), { ptr_type }, false));
+		auto release_dec = llvm::BasicBlock::Create(this->context, "dec", release);
+		auto release_free = llvm::BasicBlock::Create(this->context, "free", release);
+		auto release_done = llvm::BasicBlock::Create(this->context, "done", release);
+		builder.CreateCondBr(builder.CreateIsNull(release->getArg(0)), release_done, release_dec);
+		builder.SetInsertPoint(release_dec);
+		counter = builder.CreateConstGEP1_64(builder.getInt8Ty(), release->getArg(0), -8);
+		llvm::Value *last;
+		if (atomic) {
+			auto prev = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Sub, counter, builder.getInt64(1),
+			                                    llvm::MaybeAlign(8), llvm::AtomicOrdering::AcquireRelease);
+			last = builder.CreateICmpEQ(prev, builder.getInt64(1));
+		} else {
+			auto count = builder.CreateSub(builder.CreateLoad(i64_type, counter), builder.getInt64(1));
+			builder.CreateStore(count, counter);
+			last = builder.CreateICmpEQ(count, builder.getInt64(0));
+		}
+		builder.CreateCondBr(last, release_free, release_done);
+		builder.SetInsertPoint(release_free);
+		builder.CreateCall(free_func, { counter });
+		builder.CreateBr(release_done);
+		builder.SetInsertPoint(release_done);
+		builder.CreateRetVoid();
+	}
+
+	return this->module.getFunction(RcRuntime::name(kind, op));
+}
+
+// The arena an `alloc`/`free` call refers to: an explicitly passed one or the innermost `arena` scope.
+// Returns `nullptr` for heap memory.
+llvm::Value *Codegen::alloc_arena(CallExprAst *expr)
+{
+	if (expr->args.size() == 1) {
+		auto var = dynamic_cast<VariableExprAst *>(expr->args[0].get());
+		if (!var || this->variables.find(var->name) == this->variables.end())
+			return nullptr;
+
+		auto &binding = this->variables[var->name];
+		if (expr->function == "free")
+			return binding.arena ? binding.value : nullptr;
+
+		return binding.type == this->arena_type() ? binding.value : nullptr;
+	}
+
+	if (expr->args.empty() && !this->arenas.empty())
+		return this->arenas.back();
+
+	return nullptr;
+}
+
+bool Codegen::include(ArenaExprAst *expr)
+{
+	if (!this->builder.GetInsertBlock())
+		return false;
+
+	// A zeroed arena is empty, the first allocation grabs a chunk
+	auto type = this->arena_type();
+	auto slot = this->entry_alloca(type, expr->name->name);
+	this->builder.CreateStore(llvm::Constant::getNullValue(type), slot);
+
+	this->push_scope();
+	this->declare(expr->name->name, Variable { type, slot });
+	this->scopes.back().cleanups.push_back(Cleanup { [this, slot]() {
+		this->builder.CreateCall(this->arena_runtime("__1337_arena_release"), { slot });
+		return true;
+	}, 1 });
+
+	this->arenas.push_back(slot);
+	bool ok = this->include(expr->body.get());
+	this->arenas.pop_back();
+	if (!ok)
+		return false;
+
+	return this->pop_scope();
+}
+
+// Mirrors `struct __1337_arena` from runtime/arena.h
+llvm::StructType *Codegen::arena_type()
+{
+	if (auto type = llvm::StructType::getTypeByName(this->context, "__1337_arena"); type != nullptr)
+		return type;
+
+	auto ptr_type = this->builder.getPtrTy();
+	return llvm::StructType::create(this->context, { ptr_type, ptr_type, ptr_type, ptr_type, ptr_type, this->builder.getInt64Ty() }, "__1337_arena");
+}
+
+llvm::Function *Codegen::arena_runtime(std::string name)
+{
+	if (auto function = this->module.getFunction(name); function != nullptr)
+		return function;
+
+	auto builder = llvm::IRBuilder<>(this->context);
+	auto ptr_type = builder.getPtrTy();
+	auto i64_type = builder.getInt64Ty();
+
+	if (name == "__1337_arena_release") {
+		return llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), { ptr_type }, false),
+		                              llvm::Function::ExternalLinkage, name, this->module);
+	}
+
+	// Bump pointer fast path, the runtime only gets called when the current chunk is full
+	auto alloc_type = llvm::FunctionType::get(ptr_type, { ptr_type, i64_type, i64_type }, false);
+	auto slow = this->module.getOrInsertFunction("__1337_arena_alloc_slow", alloc_type);
+	auto alloc = llvm::Function::Create(alloc_type, llvm::Function::LinkOnceODRLinkage, "__1337_arena_alloc", this->module);
+	auto entry = llvm::BasicBlock::Create(this->context, "entry", alloc);
+	auto fits = llvm::BasicBlock::Create(this->context, "fits", alloc);
+	auto bump = llvm::BasicBlock::Create(this->context, "bump", alloc);
+	auto refill = llvm::BasicBlock::Create(this->context, "refill", alloc);
+	auto arena = alloc->getArg(0);
+	auto size = alloc->getArg(1);
+	auto align = alloc->getArg(2);
+
+	builder.SetInsertPoint(entry);
+	auto end_ptr = builder.CreateStructGEP(this->arena_type(), arena, 1);
+	auto cursor = builder.CreatePtrToInt(builder.CreateLoad(ptr_type, arena), i64_type);
+	auto end = builder.CreatePtrToInt(builder.CreateLoad(ptr_type, end_ptr), i64_type);
+	auto mask = builder.CreateSub(align, builder.getInt64(1));
+	auto aligned = builder.CreateAnd(builder.CreateAdd(cursor, mask), builder.CreateNot(mask));
+	auto in_chunk = builder.CreateAnd(builder.CreateIsNotNull(cursor), builder.CreateICmpULE(aligned, end));
+	builder.CreateCondBr(in_chunk, fits, refill);
+
+	builder.SetInsertPoint(fits);
+	builder.CreateCondBr(builder.CreateICmpUGE(builder.CreateSub(end, aligned), size), bump, refill);
+
+	builder.SetInsertPoint(bump);
+	auto result = builder.CreateIntToPtr(aligned, ptr_type);
+	builder.CreateStore(builder.CreateIntToPtr(builder.CreateAdd(aligned, size), ptr_type), arena);
+	builder.CreateRet(result);
+
+	builder.SetInsertPoint(refill);
+	builder.CreateRet(builder.CreateCall(slow, { arena, size, align }));
+
+	return alloc;
+}
+
+llvm::AllocaInst *Codegen::entry_alloca(llvm::Type *type, std::string name)
+{
+	auto &entry = this->builder.GetInsertBlock()->getParent()->getEntryBlock();
+	auto builder = llvm::IRBuilder<>(&entry, entry.begin());
+	return builder.CreateAlloca(type, nullptr, name);
 }
@@ -3,54 +3,287 @@
 
 #include "llvm.hpp"
 #include "ast.hpp"
+#include "refcount.hpp"
+#include "escape.hpp"
+#include "attributes.hpp"
+#include "layout.hpp"
+#include "comptime.hpp"
+#include "timing.hpp"
+#include "debuginfo.hpp"
+#include "console.hpp"
 #include <map>
+#include <tuple>
+#include <regex>
+#include <vector>
+#include <optional>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <utility>
 
+enum class OverflowMode: int {
+	Wrap,       // Two's complement wrapping, like the wrapping operators `+%`, `-%` and `*%`
+	Trap,       // Checked, overflowing traps
+	AssumeNone, // Overflow is undefined (`nsw`), so loops can be widened and vectorized
+};
+
+enum class LtoMode: int {
+	None,
+	Full, // The bitcode of every file is merged and optimized as one module
+	Thin, // Every file is optimized on its own, with the functions it calls imported from the others
+};
+
+struct CodegenOptions {
+	unsigned int opt_level = 0; // -O0 ... -O3
+	std::string remarks; // -Rpass=<regex>, passes to report applied optimizations for
+	std::string missed_remarks; // -Rpass-missed=<regex>, passes to report missed optimizations for
+	unsigned int cleanup_inline_threshold = 16; // -fcleanup-inline-threshold=<n>, bigger cleanups get a shared block
+	OverflowMode overflow = OverflowMode::Wrap; // -foverflow=wrap|trap|assume-none, for the integer operators
+	bool dump_struct_layouts = false; // -fdump-struct-layouts, prints the layout of every struct
+	uint64_t comptime_steps = ComptimeLimits {}.steps; // -fcomptime-steps=<n>, per `comptime` expression
+	uint64_t comptime_memory = ComptimeLimits {}.memory; // -fcomptime-memory=<bytes>, per `comptime` expression
+	bool lazy = false; // -flazy, only generates the declarations `main` and the `pub` ones use
+	LtoMode lto = LtoMode::None; // -flto[=full|thin], emits bitcode for the link step instead of an object
+	std::string profile_generate; // -fprofile-generate[=<file>], instruments the code to write its counts to <file>
+	std::string profile_use; // -fprofile-use=<file>, optimizes with the counts merged into a .profdata file
+	std::string triple; // -target <triple>, the host when empty
+	bool dump_ir = false; // -fdump-ir, prints the optimized IR to stderr
+	bool dump_asm = false; // -fdump-asm, prints the assembly to stderr
+	bool dump_bitcode = false; // -fdump-bitcode, writes the optimized module next to the object, as .bc
+	DebugInfoKind debug_info = DebugInfoKind::None; // -g/-gline-tables-only
+	bool instrument = false; // -finstrument, counts and times the calls of every function for a flat profile at exit
+	TimeReport *time_report = nullptr; // -ftime-report/-ftime-trace=<file>, gets a span for every pass
+};
+
+// Prints the optimization remarks of the passes selected by `-Rpass`/`-Rpass-missed`
+struct RemarkHandler : public llvm::DiagnosticHandler {
+	std::optional<std::regex> passed;
+	std::optional<std::regex> missed;
+
+	inline RemarkHandler(const CodegenOptions &options)
+	{
+		if (!options.remarks.empty())
+			this->passed = std::regex(options.remarks);
+		if (!options.missed_remarks.empty())
+			this->missed = std::regex(options.missed_remarks);
+	}
+
+	inline bool isPassedOptRemarkEnabled(llvm::StringRef pass) const override
+	{
+		return this->passed && std::regex_match(pass.str(), *this->passed);
+	}
+
+	inline bool isMissedOptRemarkEnabled(llvm::StringRef pass) const override
+	{
+		return this->missed && std::regex_match(pass.str(), *this->missed);
+	}
+
+	inline bool isAnyRemarkEnabled() const override
+	{
+		return this->passed || this->missed;
+	}
+
+	inline bool handleDiagnostics(const llvm::DiagnosticInfo &info) override
+	{
+		auto remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&info);
+		if (!remark)
+			return false;
+
+		bool missed = remark->getKind() == llvm::DK_OptimizationRemarkMissed;
+		if (missed ? !this->isMissedOptRemarkEnabled(remark->getPassName()) :
+		             !this->isPassedOptRemarkEnabled(remark->getPassName()))
+			return true;
+
+		console_errors() << "remark: " << remark->getMsg() << " [" << (missed ? "-Rpass-missed" : "-Rpass") <<
+			"=" << remark->getPassName() << "]\n";
+		return true;
+	}
+};
+
+struct Variable {
+	llvm::Type *type;
+	llvm::Value *value;
+	RcKind rc = RcKind::None; // Reference counted locals release their reference when the scope ends
+	bool arena = false; // Memory owned by an arena, freeing it is a no-op
+	bool mut = false; // Can be assigned to
+	bool readonly = false; // Points to memory the current function must not write to or free
+	StructLayout *pointee = nullptr; // The struct a pointer points to, its fields are reached with `.`
+	StructLayout *elements = nullptr; // For a `soa<T>`, the struct that is stored as one array per field
+};
+
+// Where a load or store of a field goes and what it may assume
+struct FieldAccess {
+	StructField *field = nullptr;
+	uint64_t align = 1;
+	llvm::AAMDNodes aliasing; // The arrays of the fields of a `soa<T>` never overlap
+};
+
+struct Cleanup {
+	std::function<bool()> emit; // Fails if the cleanup can't be generated
+	size_t cost; // About the instructions one expansion emits
+};
+
+struct Scope {
+	std::map<std::string, std::optional<Variable>> shadowed; // Bindings to restore when the scope ends
+	std::vector<Cleanup> cleanups; // Emitted in reverse order at every exit of the scope
+	// Shared cleanup blocks for exits of big cleanups, by (cleanups registered so far, outermost scope left, destination)
+	std::map<std::tuple<size_t, size_t, llvm::BasicBlock *>, llvm::BasicBlock *> exits;
+};
+
+// Puts the debug location of the enclosing expression back once an inner one is generated
+struct LocationScope {
+	llvm::IRBuilder<> &builder;
+	llvm::DebugLoc outer;
+
+	inline ~LocationScope()
+	{
+		this->builder.SetCurrentDebugLocation(this->outer);
+	}
+};
+
+// `-target`, or the host when there is none
+inline std::string target_triple(const CodegenOptions &options)
+{
+	return options.triple.empty() ? llvm::sys::getDefaultTargetTriple() : llvm::Triple::normalize(options.triple);
+}
+
+// The target registry is shared by the `Codegen`s of every thread and the link step. Only the
+// host's backend is registered up front, registering all of them was a good part of the startup.
+// The others are only linked in with `-DLLVM_TARGETS=all`, otherwise other triples aren't found.
+inline const llvm::Target *initialize_target(const std::string &triple)
+{
+	static std::once_flag native;
+	std::call_once(native, []() {
+		llvm::InitializeNativeTarget();
+		llvm::InitializeNativeTargetAsmPrinter();
+	});
+
+	std::string error;
+	auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+#ifdef _1337_ALL_TARGETS
+	static std::once_flag all;
+	if (target == nullptr) {
+		std::call_once(all, []() {
+			llvm::InitializeAllTargetInfos();
+			llvm::InitializeAllTargets();
+			llvm::InitializeAllTargetMCs();
+			llvm::InitializeAllAsmPrinters();
+		});
+		target = llvm::TargetRegistry::lookupTarget(triple, error);
+	}
+#endif
+	return target;
+}
+
 class Codegen {
 private:
+	CodegenOptions options;
 	llvm::LLVMContext context;
 	llvm::Module module;
 	llvm::IRBuilder<> builder;
-	std::map<std::string, std::pair<llvm::Type *, llvm::Value *>> variables;
+	Comptime comptime;
+	std::unique_ptr<llvm::TargetMachine> target_machine = nullptr;
+	std::map<std::string, Variable> variables;
+	std::vector<Scope> scopes;
+	std::map<llvm::Function *, std::vector<RcKind>> rc_params; // Reference counted parameters are owned by the callee
+	std::map<llvm::Function *, RcKind> rc_returns; // Returned reference counted objects are owned by the caller
+	std::vector<llvm::Value *> arenas; // Arenas of the enclosing `arena` scopes, innermost last
+	llvm::AllocaInst *return_slot = nullptr; // Return value of the current function on its way through shared cleanup blocks
+	std::map<std::string, DeclarationExprAst *> generics; // Generic functions, they only generate code when instantiated
+	std::map<std::pair<DeclarationExprAst *, std::string>, llvm::Function *> instances; // By generic function and type arguments
+	std::map<std::string, TypeExprAst *> type_bindings; // Type parameters of the instance being generated
+	std::vector<std::unique_ptr<TypeExprAst>> instance_types; // Owns the type arguments bound by the instances
+	size_t instantiation_depth = 0;
+	std::map<std::string, StructLayout> structs;
+	std::map<llvm::Function *, StructLayout *> pointee_returns; // Functions returning pointers to structs
+	std::map<llvm::Function *, StructLayout *> soa_returns; // Functions returning a `soa<T>`
+	std::map<StructLayout *, std::vector<llvm::MDNode *>> soa_scopes; // An alias scope for the header and per field, for `soa<T>`
+	std::unique_ptr<DebugInfo> debug_info; // Only with `-g`/`-gline-tables-only`
+	std::vector<llvm::WeakTrackingVH> instrumented; // Defined functions, with `-finstrument`
 public:
-	inline Codegen()
-		: context(), builder(this->context), module("<module>", this->context)
+	// The source names the module, profiles tell the internal functions of different files apart by it
+	inline Codegen(CodegenOptions options = {}, std::string source = "<module>")
+		: options(options), context(), builder(this->context), module(source, this->context),
+		  comptime(this->module, [this](TypeExprAst *type) { return this->type(type); },
+		           ComptimeLimits { options.comptime_steps, options.comptime_memory }, options.overflow == OverflowMode::Wrap)
 	{
+		if (!options.remarks.empty() || !options.missed_remarks.empty())
+			this->context.setDiagnosticHandler(std::make_unique<RemarkHandler>(options));
+
 		// Add printf declaration
 		auto printf_type = llvm::FunctionType::get(builder.getInt32Ty(), { builder.getPtrTy() }, true);
 		auto printf_func = llvm::Function::Create(printf_type, llvm::Function::ExternalLinkage, "printf", module);
+
+		// The sizes of the described types come from the data layout
+		if (options.debug_info != DebugInfoKind::None) {
+			this->target();
+			this->debug_info = std::make_unique<DebugInfo>(this->module, source, options.debug_info, options.opt_level > 0);
+		}
 	}
 public:
+	bool predeclare(ExprAst *expr);
 	bool include(ExprAst *expr);
 	bool include(DeclarationExprAst *expr);
 	bool include(CallExprAst *expr);
+	bool include(CodeblockExprAst *expr, llvm::Value **value = nullptr);
+	bool include(IfExprAst *expr, llvm::Value **value = nullptr);
+	bool include(ArenaExprAst *expr);
+	bool include(DeferExprAst *expr);
+	bool include(ReturnExprAst *expr);
+	bool include(BecomeExprAst *expr);
+	bool include(AssignExprAst *expr);
+	bool include(ExternExprAst *expr);
 	llvm::Value *eval(ExprAst *expr);
 	llvm::Value *eval(StringExprAst *expr);
 	llvm::Value *eval(NumberExprAst *expr);
 	llvm::Value *eval(VariableExprAst *expr);
 	llvm::Value *eval(ArrayIndexExprAst *expr);
+	llvm::Value *eval(CallExprAst *expr);
+	llvm::Value *eval(BinaryOpExprAst *expr);
+	llvm::Value *eval(IfExprAst *expr);
+	llvm::Value *eval(MemberExprAst *expr);
+	llvm::Value *eval(ComptimeExprAst *expr, llvm::Type *hint = nullptr);
 	llvm::Type *type(TypeExprAst *expr);
+	void optimize();
 
+	// The assembly is generated from a copy, the code generator changes the IR it runs on
 	inline void dump()
 	{
-		this->module.dump();
+		if (this->options.dump_ir)
+			this->module.print(console_errors(), nullptr);
+
+		if (this->options.dump_asm) {
+			auto copy = llvm::CloneModule(this->module);
+			llvm::SmallString<0> text;
+			llvm::raw_svector_ostream assembly(text);
+			llvm::legacy::PassManager pass;
+			if (this->target()->addPassesToEmitFile(pass, assembly, nullptr, llvm::CodeGenFileType::AssemblyFile))
+				std::cout << "failed to add passes to emit assembly" << std::endl;
+			else
+				pass.run(*copy);
+			console_errors() << text;
+		}
+		console_errors().flush();
 	}
 
-	inline bool write_object(std::string path)
+	inline llvm::TargetMachine *target()
 	{
-		llvm::InitializeAllTargetInfos();
-		llvm::InitializeAllTargets();
-		llvm::InitializeAllTargetMCs();
-		llvm::InitializeAllAsmParsers();
-		llvm::InitializeAllAsmPrinters();
-		std::string error;
-		auto triple = llvm::sys::getDefaultTargetTriple();
-		auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+		if (this->target_machine)
+			return this->target_machine.get();
+
+		// An unknown `-target` is rejected before anything is compiled
+		auto triple = target_triple(this->options);
+		auto target = initialize_target(triple);
 		llvm::TargetOptions opt;
-		auto target_machine = target->createTargetMachine(triple, "generic", "", opt, llvm::Reloc::PIC_);
-		module.setDataLayout(target_machine->createDataLayout());
+		this->target_machine.reset(target->createTargetMachine(triple, "generic", "", opt, llvm::Reloc::PIC_));
+		module.setTargetTriple(triple);
+		module.setDataLayout(this->target_machine->createDataLayout());
 
+		return this->target_machine.get();
+	}
+
+	inline bool write_object(std::string path)
+	{
 		// Generate object
 		std::error_code errcode;
 		auto output_file = llvm::raw_fd_ostream(path, errcode, llvm::sys::fs::OF_None);
@@ -59,19 +292,108 @@ public:
 			return false;
 		}
 
+		if (!this->emit_object(output_file))
+			return false;
+		output_file.flush();
+
+		std::cout << "Successfully created object file '" << path << "'" << std::endl;
+
+		return true;
+	}
+
+	// Into a file, or into memory for `-o prog`, which links the object without writing it
+	inline bool emit_object(llvm::raw_pwrite_stream &stream)
+	{
 		llvm::legacy::PassManager pass;
-		if (target_machine->addPassesToEmitFile(pass, output_file, nullptr, llvm::CodeGenFileType::ObjectFile)) {
+		if (this->target()->addPassesToEmitFile(pass, stream, nullptr, llvm::CodeGenFileType::ObjectFile)) {
 			std::cout << "failed to add passes to emit file" << std::endl;
 			return false;
 		}
 
 		pass.run(module);
+		return true;
+	}
+
+	// For `-flto`, ThinLTO also needs the summary of what the module defines and calls
+	inline bool write_bitcode(std::string path)
+	{
+		std::error_code errcode;
+		auto output_file = llvm::raw_fd_ostream(path, errcode, llvm::sys::fs::OF_None);
+		if (errcode) {
+			std::cout << "failed to open bitcode file" << std::endl;
+			return false;
+		}
+
+		if (this->options.lto == LtoMode::Thin) {
+			llvm::ProfileSummaryInfo psi(this->module);
+			auto index = llvm::buildModuleSummaryIndex(this->module, nullptr, &psi);
+			llvm::WriteBitcodeToFile(this->module, output_file, false, &index);
+		} else {
+			llvm::WriteBitcodeToFile(this->module, output_file);
+		}
 		output_file.flush();
 
-		std::cout << "Successfully created object file 'output.o'" << std::endl;
+		std::cout << "Successfully created bitcode file '" << path << "'" << std::endl;
 
 		return true;
 	}
+private:
+	bool include_local(DeclarationExprAst *expr);
+	LocationScope locate(ExprAst *expr);
+	void instrument();
+	bool include_statements(std::vector<std::unique_ptr<ExprAst>> &subexprs, llvm::Value **value);
+	bool is_value(ExprAst *expr);
+	llvm::GlobalValue::LinkageTypes linkage(DeclarationExprAst *expr);
+	llvm::Function *prototype(DeclarationExprAst *expr, FunctionProtoExprAst *proto, std::string name);
+	bool define(llvm::Function *function, FunctionExprAst *func);
+	bool is_generic(DeclarationExprAst *expr);
+	llvm::Function *callee(CallExprAst *expr);
+	llvm::Function *instantiate(DeclarationExprAst *expr, std::vector<std::unique_ptr<TypeExprAst>> &type_args);
+	std::unique_ptr<TypeExprAst> substitute(TypeExprAst *expr);
+	std::string mangle(TypeExprAst *expr);
+	bool define_struct(DeclarationExprAst *expr, StructTypeExprAst *type);
+	StructLayout *layout(llvm::Type *type);
+	bool is_split(llvm::Type *type);
+	uint64_t align_of(llvm::Type *type);
+	StructLayout *pointee(TypeExprAst *expr);
+	StructLayout *pointee(ExprAst *expr);
+	StructLayout *struct_of(ExprAst *expr, bool &by_value);
+	llvm::Value *address(MemberExprAst *expr, bool write, FieldAccess &access);
+	StructLayout *elements(TypeExprAst *expr);
+	StructLayout *elements(ExprAst *expr);
+	llvm::StructType *soa_header(StructLayout *layout);
+	uint64_t soa_align(StructLayout *layout);
+	llvm::Value *soa_alloc(CallExprAst *expr);
+	llvm::Value *soa_len(CallExprAst *expr);
+	llvm::AAMDNodes soa_aliasing(StructLayout *layout, size_t position);
+	llvm::Value *soa_element(ArrayIndexExprAst *expr, StructLayout *layout, bool write, FieldAccess &access);
+	bool call_args(CallExprAst *expr, llvm::Function *function, std::vector<llvm::Value *> &args,
+	               std::vector<std::pair<RcKind, llvm::Value *>> &temporaries);
+	llvm::Constant *number(NumberExprAst *expr, llvm::Type *type);
+	llvm::Value *operand(ExprAst *expr, llvm::Type *hint);
+	llvm::Value *convert(llvm::Value *value, llvm::Type *type);
+	llvm::Type *common_type(llvm::Type *a, llvm::Type *b);
+	llvm::Value *condition(llvm::Value *value);
+	llvm::Value *int_arithmetic(llvm::Instruction::BinaryOps op, llvm::Value *left, llvm::Value *right, bool wrapping);
+	void trap_if(llvm::Value *condition);
+	llvm::Value *owned(ExprAst *expr, llvm::Value *value);
+	bool is_readonly(ExprAst *expr);
+	RcKind rc_kind(TypeExprAst *expr);
+	RcKind rc_kind(ExprAst *expr);
+	llvm::Function *rc_runtime(RcKind kind, RcOp op);
+	llvm::Value *rc_alloc(CallExprAst *expr);
+	llvm::Value *alloc(CallExprAst *expr);
+	llvm::Value *alloc_arena(CallExprAst *expr);
+	llvm::StructType *arena_type();
+	llvm::Function *arena_runtime(std::string name);
+	llvm::AllocaInst *entry_alloca(llvm::Type *type, std::string name);
+	void declare(std::string name, Variable var);
+	void push_scope();
+	bool pop_scope();
+	bool exit_scopes(size_t from, size_t depth, llvm::BasicBlock *dest, llvm::Value *value = nullptr);
+	bool emit_cleanups(Scope &scope, size_t count);
+	size_t cleanup_cost(Scope &scope, size_t count);
+	bool is_terminated();
 };
 
 #endif
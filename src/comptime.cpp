@@ -0,0 +1,637 @@
+#include "comptime.hpp"
+#include <optional>
+
+// What a call costs besides its locals, so deep recursion runs into the memory limit as well
+static constexpr uint64_t frame_bytes = 64;
+
+// Same rules as `Codegen::common_type`
+static llvm::Type *common_type(llvm::Type *a, llvm::Type *b)
+{
+	if (a == b)
+		return a;
+
+	if (a->isIntegerTy() && b->isIntegerTy())
+		return a->getIntegerBitWidth() >= b->getIntegerBitWidth() ? a : b;
+	if (a->isFloatingPointTy() && b->isFloatingPointTy())
+		return a->getPrimitiveSizeInBits() >= b->getPrimitiveSizeInBits() ? a : b;
+	if (a->isFloatingPointTy() && b->isIntegerTy())
+		return a;
+	if (a->isIntegerTy() && b->isFloatingPointTy())
+		return b;
+
+	return nullptr;
+}
+
+static bool is_number(llvm::Type *type)
+{
+	return type && (type->isIntegerTy() || type->isFloatingPointTy());
+}
+
+// Evaluates `expr`, converted to `type` if it isn't `nullptr`. A `table(...)` evaluates to an
+// array, `type` is its element type then.
+llvm::Constant *Comptime::run(ExprAst *expr, llvm::Type *type)
+{
+	this->error.clear();
+	this->steps = 0;
+	this->memory = 0;
+	this->frames.clear();
+	this->frames.emplace_back();
+	this->push_scope();
+
+	llvm::Constant *result;
+	auto call = dynamic_cast<CallExprAst *>(expr);
+	if (call && call->function == "table" && this->functions.count("table") == 0)
+		result = this->table(call, type);
+	else if ((result = this->value(expr, type)) != nullptr && type)
+		result = this->convert(expr, result, type);
+
+	if (result && !is_number(result->getType()) && !result->getType()->isArrayTy()) {
+		this->fail(expr, "the result isn't a number");
+		result = nullptr;
+	}
+
+	this->frames.clear();
+	return result;
+}
+
+llvm::Constant *Comptime::value(ExprAst *expr, llvm::Type *hint)
+{
+	if (!this->step(expr))
+		return nullptr;
+
+	if (auto number = dynamic_cast<NumberExprAst *>(expr); number != nullptr)
+		return this->number(number, hint);
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr)
+		return this->variable(var);
+	if (auto index = dynamic_cast<ArrayIndexExprAst *>(expr); index != nullptr)
+		return this->element(index);
+	if (auto binop = dynamic_cast<BinaryOpExprAst *>(expr); binop != nullptr)
+		return this->binary(binop);
+	if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr)
+		return this->call(call);
+	if (auto comptime = dynamic_cast<ComptimeExprAst *>(expr); comptime != nullptr)
+		return this->value(comptime->expr.get(), hint);
+
+	if (dynamic_cast<IfExprAst *>(expr) != nullptr || dynamic_cast<CodeblockExprAst *>(expr) != nullptr) {
+		llvm::Constant *result = nullptr;
+		auto flow = this->statement(expr, &result);
+		if (flow == Flow::Fail)
+			return nullptr;
+		if (flow != Flow::Next) {
+			this->fail(expr, "can't leave a function from the middle of an expression");
+			return nullptr;
+		}
+		if (!result)
+			this->fail(expr, "no value");
+		return result;
+	}
+
+	this->fail(expr, "can't be evaluated at compile time");
+	return nullptr;
+}
+
+// Number literals get the type that is expected of them, like in `Codegen::operand`
+llvm::Constant *Comptime::number(NumberExprAst *expr, llvm::Type *hint)
+{
+	bool is_float = expr->number.find('.') != std::string::npos;
+	auto &context = this->module.getContext();
+	llvm::Type *type;
+	if (hint && (hint->isFloatingPointTy() || (hint->isIntegerTy() && !is_float)))
+		type = hint;
+	else
+		type = is_float ? llvm::Type::getDoubleTy(context) : llvm::Type::getInt32Ty(context);
+
+	if (type->isIntegerTy())
+		return llvm::ConstantInt::get(context, llvm::APInt(type->getIntegerBitWidth(), expr->number, 10));
+
+	return llvm::ConstantFP::get(type, expr->number);
+}
+
+// The innermost local of the current call called `name`
+Comptime::Local *Comptime::local(const std::string &name)
+{
+	auto &scopes = this->frames.back().scopes;
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+		if (auto it = scope->locals.find(name); it != scope->locals.end())
+			return &it->second;
+	}
+
+	return nullptr;
+}
+
+llvm::Constant *Comptime::variable(VariableExprAst *expr)
+{
+	if (auto local = this->local(expr->name); local != nullptr)
+		return local->value;
+
+	if (auto it = this->globals.find(expr->name); it != this->globals.end())
+		return it->second;
+
+	this->fail(expr, "'" + expr->name + "' has no value at compile time");
+	return nullptr;
+}
+
+// Tables computed by earlier `comptime` declarations can be read
+llvm::Constant *Comptime::element(ArrayIndexExprAst *expr)
+{
+	auto table = this->variable(expr->var.get());
+	if (!table)
+		return nullptr;
+
+	auto type = llvm::dyn_cast<llvm::ArrayType>(table->getType());
+	if (!type) {
+		this->fail(expr, "'" + expr->var->name + "' isn't a table");
+		return nullptr;
+	}
+
+	auto index = llvm::dyn_cast_or_null<llvm::ConstantInt>(this->value(expr->index.get(), nullptr));
+	if (!index) {
+		if (this->error.empty())
+			this->fail(expr, "the index isn't an integer");
+		return nullptr;
+	}
+
+	if (index->getValue().isNegative() || index->getValue().uge(type->getNumElements())) {
+		this->fail(expr, "index " + llvm::toString(index->getValue(), 10, true) + " is out of bounds of '" + expr->var->name + "'");
+		return nullptr;
+	}
+
+	return table->getAggregateElement(static_cast<unsigned int>(index->getZExtValue()));
+}
+
+// Mirrors `Codegen::eval(BinaryOpExprAst *)`
+llvm::Constant *Comptime::binary(BinaryOpExprAst *expr)
+{
+	llvm::Constant *left, *right;
+	if (dynamic_cast<NumberExprAst *>(expr->left.get()) && !dynamic_cast<NumberExprAst *>(expr->right.get())) {
+		if (!(right = this->value(expr->right.get(), nullptr)))
+			return nullptr;
+		left = this->value(expr->left.get(), right->getType());
+	} else {
+		if (!(left = this->value(expr->left.get(), nullptr)))
+			return nullptr;
+		right = this->value(expr->right.get(), left->getType());
+	}
+	if (!left || !right)
+		return nullptr;
+
+	auto &op = expr->op;
+	auto type = is_number(left->getType()) && is_number(right->getType()) ?
+		common_type(left->getType(), right->getType()) : nullptr;
+	if (!type) {
+		this->fail(expr, "'" + op + "' only works on numbers at compile time");
+		return nullptr;
+	}
+	if (!(left = this->convert(expr, left, type)) || !(right = this->convert(expr, right, type)))
+		return nullptr;
+
+	static const std::map<std::string, std::pair<llvm::Instruction::BinaryOps, llvm::Instruction::BinaryOps>> arithmetic = {
+		{ "+", { llvm::Instruction::Add, llvm::Instruction::FAdd } },
+		{ "-", { llvm::Instruction::Sub, llvm::Instruction::FSub } },
+		{ "*", { llvm::Instruction::Mul, llvm::Instruction::FMul } },
+		{ "/", { llvm::Instruction::SDiv, llvm::Instruction::FDiv } },
+	};
+	static const std::map<std::string, std::pair<llvm::CmpInst::Predicate, llvm::CmpInst::Predicate>> comparisons = {
+		{ "==", { llvm::CmpInst::ICMP_EQ, llvm::CmpInst::FCMP_OEQ } },
+		{ "!=", { llvm::CmpInst::ICMP_NE, llvm::CmpInst::FCMP_UNE } },
+		{ "<", { llvm::CmpInst::ICMP_SLT, llvm::CmpInst::FCMP_OLT } },
+		{ ">", { llvm::CmpInst::ICMP_SGT, llvm::CmpInst::FCMP_OGT } },
+		{ "<=", { llvm::CmpInst::ICMP_SLE, llvm::CmpInst::FCMP_OLE } },
+		{ ">=", { llvm::CmpInst::ICMP_SGE, llvm::CmpInst::FCMP_OGE } },
+	};
+
+	auto &data_layout = this->module.getDataLayout();
+	bool fp = type->isFloatingPointTy();
+	if (auto cmp = comparisons.find(op); cmp != comparisons.end())
+		return llvm::ConstantFoldCompareInstOperands(fp ? cmp->second.second : cmp->second.first, left, right, data_layout);
+
+	bool wrapping = op.size() == 2 && op[1] == '%';
+	auto arith = arithmetic.find(wrapping ? op.substr(0, 1) : op);
+	if (arith == arithmetic.end() || (fp && wrapping)) {
+		this->fail(expr, "'" + op + "' doesn't work on these operands");
+		return nullptr;
+	}
+
+	if (fp)
+		return llvm::ConstantFoldBinaryOpOperands(arith->second.second, left, right, data_layout);
+
+	return this->int_arithmetic(expr, arith->second.first, left, right, wrapping);
+}
+
+// Results that would trap or be undefined at runtime are errors, wrapping ones wrap
+llvm::Constant *Comptime::int_arithmetic(BinaryOpExprAst *expr, llvm::Instruction::BinaryOps op, llvm::Constant *left,
+                                         llvm::Constant *right, bool wrapping)
+{
+	auto &a = llvm::cast<llvm::ConstantInt>(left)->getValue();
+	auto &b = llvm::cast<llvm::ConstantInt>(right)->getValue();
+	bool overflow = false;
+	llvm::APInt result;
+
+	switch (op) {
+	case llvm::Instruction::Add:
+		result = a.sadd_ov(b, overflow);
+		break;
+	case llvm::Instruction::Sub:
+		result = a.ssub_ov(b, overflow);
+		break;
+	case llvm::Instruction::Mul:
+		result = a.smul_ov(b, overflow);
+		break;
+	default:
+		if (b.isZero()) {
+			this->fail(expr, "division by zero");
+			return nullptr;
+		}
+
+		// `INT_MIN / -1` doesn't wrap, it traps
+		result = a.sdiv_ov(b, overflow);
+		wrapping = false;
+		break;
+	}
+
+	if (overflow && !wrapping && !(this->wrap && op != llvm::Instruction::SDiv)) {
+		this->fail(expr, "'" + expr->op + "' overflows");
+		return nullptr;
+	}
+
+	return llvm::ConstantInt::get(this->module.getContext(), result);
+}
+
+llvm::Constant *Comptime::call(CallExprAst *expr)
+{
+	FunctionExprAst *func;
+	std::vector<llvm::Constant *> args;
+	if (!this->arguments(expr, func, args))
+		return nullptr;
+
+	return this->invoke(expr, func, args);
+}
+
+// The function a call refers to and its arguments, converted to the parameter types
+bool Comptime::arguments(CallExprAst *expr, FunctionExprAst *&func, std::vector<llvm::Constant *> &args)
+{
+	auto it = this->functions.find(expr->function);
+	if (it == this->functions.end() || !expr->type_args.empty())
+		return this->fail(expr, "'" + expr->function + "' can't run at compile time");
+
+	func = it->second;
+	auto &params = func->proto->params;
+	if (params.size() != expr->args.size())
+		return this->fail(expr, "'" + expr->function + "' takes " + std::to_string(params.size()) + " arguments");
+
+	for (size_t i = 0; i < params.size(); ++i) {
+		auto type = this->type(params[i]->type.get());
+		auto arg = type ? this->value(expr->args[i].get(), type) : nullptr;
+		if (!arg || !(arg = this->convert(expr->args[i].get(), arg, type)))
+			return false;
+
+		args.push_back(arg);
+	}
+
+	return true;
+}
+
+llvm::Constant *Comptime::invoke(ExprAst *site, FunctionExprAst *func, std::vector<llvm::Constant *> args)
+{
+	if (this->frames.size() > this->limits.depth) {
+		this->fail(site, "calls nested more than " + std::to_string(this->limits.depth) + " deep");
+		return nullptr;
+	}
+
+	// `become` starts over with the next function in the same place
+	while (true) {
+		auto &proto = func->proto;
+		llvm::Type *ret_type = nullptr;
+		if (proto->return_type && !(ret_type = this->type(proto->return_type.get())))
+			return nullptr;
+
+		this->frames.emplace_back();
+		this->frames.back().ret_type = ret_type;
+		this->push_scope();
+		bool ok = this->allocate(site, frame_bytes);
+		for (size_t i = 0; ok && i < args.size(); ++i) {
+			auto &param = proto->params[i];
+			ok = this->allocate(site, this->module.getDataLayout().getTypeAllocSize(args[i]->getType()));
+			this->frames.back().scopes.back().locals[param->var->name] = Local { args[i], param->mut };
+		}
+
+		llvm::Constant *result = nullptr;
+		auto flow = ok ? this->statements(func->body->subexprs, ret_type ? &result : nullptr) : Flow::Fail;
+
+		auto &frame = this->frames.back();
+		if (flow == Flow::Return)
+			result = frame.result;
+		auto next = frame.next;
+		auto next_args = frame.next_args;
+		this->memory -= frame.bytes;
+		this->frames.pop_back();
+
+		if (flow == Flow::Fail)
+			return nullptr;
+		if (flow == Flow::Become) {
+			func = next;
+			args = next_args;
+			continue;
+		}
+
+		if (!ret_type)
+			return llvm::ConstantTokenNone::get(this->module.getContext());
+		if (!result) {
+			this->fail(site, "the function doesn't return a value");
+			return nullptr;
+		}
+
+		return this->convert(site, result, ret_type);
+	}
+}
+
+// Token Patterns: table(count, function)
+llvm::Constant *Comptime::table(CallExprAst *expr, llvm::Type *element)
+{
+	auto &context = this->module.getContext();
+	auto i64_type = llvm::Type::getInt64Ty(context);
+	auto name = expr->args.size() == 2 ? dynamic_cast<VariableExprAst *>(expr->args[1].get()) : nullptr;
+	auto it = name ? this->functions.find(name->name) : this->functions.end();
+	if (it == this->functions.end()) {
+		this->fail(expr, "expected table(count, function)");
+		return nullptr;
+	}
+
+	auto func = it->second;
+	auto &proto = func->proto;
+	auto index_type = proto->params.size() == 1 ? this->type(proto->params[0]->type.get()) : nullptr;
+	if (!index_type || !index_type->isIntegerTy() || !proto->return_type) {
+		this->fail(expr, "'" + name->name + "' has to take an integer index and return the element");
+		return nullptr;
+	}
+	if (!element && !(element = this->type(proto->return_type.get())))
+		return nullptr;
+
+	auto count = this->value(expr->args[0].get(), i64_type);
+	if (!count || !(count = this->convert(expr, count, i64_type)))
+		return nullptr;
+
+	auto n = llvm::cast<llvm::ConstantInt>(count)->getSExtValue();
+	auto size = this->module.getDataLayout().getTypeAllocSize(element).getFixedValue();
+	if (n <= 0 || static_cast<uint64_t>(n) > this->limits.memory / size) {
+		this->fail(expr, "a table of " + std::to_string(n) + " elements doesn't fit");
+		return nullptr;
+	}
+	if (!this->allocate(expr, n * size))
+		return nullptr;
+
+	std::vector<llvm::Constant *> elements;
+	for (int64_t i = 0; i < n; ++i) {
+		auto index = this->convert(expr, llvm::ConstantInt::get(i64_type, i), index_type);
+		auto value = index ? this->invoke(expr, func, { index }) : nullptr;
+		if (!value || !(value = this->convert(expr, value, element)))
+			return nullptr;
+
+		elements.push_back(value);
+	}
+
+	return llvm::ConstantArray::get(llvm::ArrayType::get(element, n), elements);
+}
+
+Comptime::Flow Comptime::statement(ExprAst *expr, llvm::Constant **value)
+{
+	if (!this->step(expr))
+		return Flow::Fail;
+
+	if (auto decl = dynamic_cast<DeclarationExprAst *>(expr); decl != nullptr)
+		return this->declare(decl);
+	if (auto assign = dynamic_cast<AssignExprAst *>(expr); assign != nullptr)
+		return this->assign(assign);
+
+	if (auto ret = dynamic_cast<ReturnExprAst *>(expr); ret != nullptr) {
+		if (this->frames.size() == 1) {
+			this->fail(expr, "return outside of a function");
+			return Flow::Fail;
+		}
+
+		if (ret->value) {
+			auto ret_type = this->frames.back().ret_type;
+			if (!ret_type) {
+				this->fail(expr, "the function has no return value");
+				return Flow::Fail;
+			}
+			auto result = this->value(ret->value.get(), ret_type);
+			if (!result || !(result = this->convert(expr, result, ret_type)))
+				return Flow::Fail;
+			this->frames.back().result = result;
+		}
+
+		return Flow::Return;
+	}
+
+	if (auto become = dynamic_cast<BecomeExprAst *>(expr); become != nullptr) {
+		if (this->frames.size() == 1) {
+			this->fail(expr, "become outside of a function");
+			return Flow::Fail;
+		}
+
+		FunctionExprAst *func;
+		std::vector<llvm::Constant *> args;
+		if (!this->arguments(become->call.get(), func, args))
+			return Flow::Fail;
+
+		this->frames.back().next = func;
+		this->frames.back().next_args = args;
+		return Flow::Become;
+	}
+
+	if (auto block = dynamic_cast<CodeblockExprAst *>(expr); block != nullptr) {
+		this->push_scope();
+		auto flow = this->statements(block->subexprs, value);
+		this->pop_scope();
+		return flow;
+	}
+
+	if (auto if_expr = dynamic_cast<IfExprAst *>(expr); if_expr != nullptr) {
+		auto cond = this->value(if_expr->condition.get(), nullptr);
+		if (!cond)
+			return Flow::Fail;
+
+		// Conditions are true when not zero, like in `Codegen::condition`
+		bool taken;
+		if (auto integer = llvm::dyn_cast<llvm::ConstantInt>(cond); integer != nullptr) {
+			taken = !integer->isZero();
+		} else if (auto fp = llvm::dyn_cast<llvm::ConstantFP>(cond); fp != nullptr) {
+			taken = !fp->isZero();
+		} else {
+			this->fail(expr, "the condition isn't a number");
+			return Flow::Fail;
+		}
+
+		if (taken)
+			return this->statement(if_expr->then_body.get(), value);
+		if (if_expr->else_body)
+			return this->statement(if_expr->else_body.get(), value);
+		return Flow::Next;
+	}
+
+	auto result = this->value(expr, nullptr);
+	if (!result)
+		return Flow::Fail;
+	if (value)
+		*value = result;
+
+	return Flow::Next;
+}
+
+Comptime::Flow Comptime::statements(std::vector<std::unique_ptr<ExprAst>> &subexprs, llvm::Constant **value)
+{
+	for (size_t i = 0; i < subexprs.size(); ++i) {
+		auto flow = this->statement(subexprs[i].get(), i + 1 == subexprs.size() ? value : nullptr);
+		if (flow != Flow::Next)
+			return flow;
+	}
+
+	return Flow::Next;
+}
+
+Comptime::Flow Comptime::declare(DeclarationExprAst *expr)
+{
+	if (this->frames.size() == 1 || expr->exported) {
+		this->fail(expr, "only locals can be declared");
+		return Flow::Fail;
+	}
+
+	llvm::Type *type = nullptr;
+	if (expr->explicit_type && !(type = this->type(expr->explicit_type.get())))
+		return Flow::Fail;
+
+	llvm::Constant *value = nullptr;
+	if (expr->value) {
+		if (!(value = this->value(expr->value.get(), type)))
+			return Flow::Fail;
+		if (type && !(value = this->convert(expr, value, type)))
+			return Flow::Fail;
+	} else if (type) {
+		value = llvm::Constant::getNullValue(type);
+	}
+
+	if (!value || !is_number(value->getType())) {
+		this->fail(expr, "'" + expr->name->name + "' has to be a number");
+		return Flow::Fail;
+	}
+	if (!this->allocate(expr, this->module.getDataLayout().getTypeAllocSize(value->getType())))
+		return Flow::Fail;
+
+	this->frames.back().scopes.back().locals[expr->name->name] = Local { value, expr->mut };
+	return Flow::Next;
+}
+
+Comptime::Flow Comptime::assign(AssignExprAst *expr)
+{
+	auto target = dynamic_cast<VariableExprAst *>(expr->target.get());
+	auto local = target ? this->local(target->name) : nullptr;
+	if (!local) {
+		this->fail(expr, "only locals can be assigned to");
+		return Flow::Fail;
+	}
+	if (!local->mut) {
+		this->fail(expr, "'" + target->name + "' isn't mut");
+		return Flow::Fail;
+	}
+
+	// Calls push frames, which moves the locals
+	auto type = local->value->getType();
+	auto value = this->value(expr->value.get(), type);
+	if (!value || !(value = this->convert(expr, value, type)))
+		return Flow::Fail;
+
+	this->local(target->name)->value = value;
+	return Flow::Next;
+}
+
+// Same conversions as `Codegen::convert`
+llvm::Constant *Comptime::convert(ExprAst *expr, llvm::Constant *value, llvm::Type *type)
+{
+	auto from = value->getType();
+	if (from == type)
+		return value;
+
+	std::optional<llvm::Instruction::CastOps> op;
+	bool is_bool = from->isIntegerTy(1);
+	if (from->isIntegerTy() && type->isIntegerTy()) {
+		op = is_bool ? llvm::Instruction::ZExt :
+		     from->getIntegerBitWidth() < type->getIntegerBitWidth() ? llvm::Instruction::SExt : llvm::Instruction::Trunc;
+	} else if (from->isIntegerTy() && type->isFloatingPointTy()) {
+		op = is_bool ? llvm::Instruction::UIToFP : llvm::Instruction::SIToFP;
+	} else if (from->isFloatingPointTy() && type->isIntegerTy()) {
+		op = llvm::Instruction::FPToSI;
+	} else if (from->isFloatingPointTy() && type->isFloatingPointTy()) {
+		op = from->getPrimitiveSizeInBits() < type->getPrimitiveSizeInBits() ? llvm::Instruction::FPExt : llvm::Instruction::FPTrunc;
+	}
+
+	auto result = op ? llvm::ConstantFoldCastOperand(*op, value, type, this->module.getDataLayout()) : nullptr;
+	if (!result) {
+		this->fail(expr, "can't convert the value to the expected type");
+		return nullptr;
+	}
+
+	// Floats out of the range of the integer type
+	if (llvm::isa<llvm::UndefValue>(result)) {
+		this->fail(expr, "the value doesn't fit the expected type");
+		return nullptr;
+	}
+
+	return result;
+}
+
+// Only numbers exist at compile time
+llvm::Type *Comptime::type(TypeExprAst *expr)
+{
+	auto &type = this->types[expr];
+	if (!type)
+		type = this->resolve(expr);
+	if (!is_number(type)) {
+		this->fail(expr, "only numbers can be used at compile time");
+		return nullptr;
+	}
+
+	return type;
+}
+
+bool Comptime::allocate(ExprAst *site, uint64_t bytes)
+{
+	auto &frame = this->frames.back();
+	frame.scopes.back().bytes += bytes;
+	frame.bytes += bytes;
+	this->memory += bytes;
+	if (this->memory > this->limits.memory)
+		return this->fail(site, "needs more than " + std::to_string(this->limits.memory) + " bytes of memory");
+
+	return true;
+}
+
+void Comptime::push_scope()
+{
+	this->frames.back().scopes.emplace_back();
+}
+
+void Comptime::pop_scope()
+{
+	auto &frame = this->frames.back();
+	frame.bytes -= frame.scopes.back().bytes;
+	this->memory -= frame.scopes.back().bytes;
+	frame.scopes.pop_back();
+}
+
+bool Comptime::step(ExprAst *expr)
+{
+	if (++this->steps <= this->limits.steps)
+		return true;
+
+	return this->fail(expr, "gave up after " + std::to_string(this->limits.steps) + " steps");
+}
+
+// Only the first error is kept, it's where things went wrong
+bool Comptime::fail(ExprAst *expr, std::string message)
+{
+	if (this->error.empty())
+		this->error = expr->source_loc().str() + ": comptime: " + message;
+
+	return false;
+}
@@ -0,0 +1,109 @@
+#ifndef _COMPTIME_HPP_
+#define _COMPTIME_HPP_
+
+#include "llvm.hpp"
+#include "ast.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+struct ComptimeLimits {
+	uint64_t steps = 10000000; // -fcomptime-steps=<n>, expressions and statements one `comptime` may evaluate
+	uint64_t memory = 64 << 20; // -fcomptime-memory=<bytes>, for the locals, call frames and tables alive at once
+	size_t depth = 512; // Nested calls, the interpreter recurses on the compiler's own stack
+};
+
+/*
+ * Runs `comptime` expressions while compiling, the program only gets the resulting constant.
+ *
+ * It is an interpreter over the AST of the top level functions. Only numbers exist at
+ * compile time, and a function may only compute with them: anything touching memory or the
+ * outside world (pointers, strings, `printf`, `alloc`, ...) is an error. Values are LLVM
+ * constants and every operation goes through LLVM's constant folder with the same opcodes
+ * and implicit conversions `Codegen` emits, so a result is exactly what the program would
+ * have computed at runtime. Integer overflow is an error unless it would wrap at runtime as
+ * well (`-foverflow=wrap` or the wrapping operators), and so is dividing by zero. `become`
+ * replaces the current call like it does at runtime, so tail recursive loops run in
+ * constant memory.
+ *
+ * Which calls may be evaluated is decided here on the AST, not with the `Effects` the
+ * `AttributeInferencePass` infers: `comptime` runs while `Codegen` is still emitting the
+ * module, long before the pass sees any IR, and the callee may not have a body yet. Only
+ * allowing numbers is a stricter version of the same purity, a function the interpreter
+ * accepts can't read, write or free memory nor synchronise.
+ *
+ * `table(count, function)` builds a lookup table: an array of `count` elements where
+ * element `i` is `function(i)`.
+ *
+ * The step and memory limits make sure a runaway evaluation ends with an error instead of
+ * hanging or exhausting the compiler.
+ */
+class Comptime {
+public:
+	std::map<std::string, FunctionExprAst *> functions; // Top level functions, by name
+	std::map<std::string, llvm::Constant *> globals; // Immutable globals with a known value
+	std::string error; // Why the last `run` failed
+private:
+	struct Local {
+		llvm::Constant *value;
+		bool mut = false;
+	};
+
+	struct Scope {
+		std::map<std::string, Local> locals;
+		uint64_t bytes = 0;
+	};
+
+	struct Frame {
+		std::vector<Scope> scopes;
+		llvm::Type *ret_type = nullptr; // `nullptr` for functions without a return value
+		uint64_t bytes = 0;
+		llvm::Constant *result = nullptr; // Set by `return`
+		FunctionExprAst *next = nullptr; // Set by `become`, with its arguments
+		std::vector<llvm::Constant *> next_args;
+	};
+
+	enum class Flow { Next, Return, Become, Fail };
+
+	llvm::Module &module;
+	std::function<llvm::Type *(TypeExprAst *)> resolve;
+	ComptimeLimits limits;
+	bool wrap; // Integer overflow wraps at runtime
+	std::map<TypeExprAst *, llvm::Type *> types; // Resolved once, calls look up their parameter types every time
+	std::vector<Frame> frames;
+	uint64_t steps = 0;
+	uint64_t memory = 0;
+public:
+	inline Comptime(llvm::Module &module, std::function<llvm::Type *(TypeExprAst *)> resolve, ComptimeLimits limits, bool wrap)
+		: module(module), resolve(resolve), limits(limits), wrap(wrap)
+	{}
+
+	llvm::Constant *run(ExprAst *expr, llvm::Type *type);
+private:
+	llvm::Constant *value(ExprAst *expr, llvm::Type *hint);
+	llvm::Constant *number(NumberExprAst *expr, llvm::Type *hint);
+	Local *local(const std::string &name);
+	llvm::Constant *variable(VariableExprAst *expr);
+	llvm::Constant *element(ArrayIndexExprAst *expr);
+	llvm::Constant *binary(BinaryOpExprAst *expr);
+	llvm::Constant *int_arithmetic(BinaryOpExprAst *expr, llvm::Instruction::BinaryOps op, llvm::Constant *left,
+	                               llvm::Constant *right, bool wrapping);
+	llvm::Constant *call(CallExprAst *expr);
+	llvm::Constant *invoke(ExprAst *site, FunctionExprAst *func, std::vector<llvm::Constant *> args);
+	bool arguments(CallExprAst *expr, FunctionExprAst *&func, std::vector<llvm::Constant *> &args);
+	llvm::Constant *table(CallExprAst *expr, llvm::Type *element);
+	Flow statement(ExprAst *expr, llvm::Constant **value);
+	Flow statements(std::vector<std::unique_ptr<ExprAst>> &subexprs, llvm::Constant **value);
+	Flow declare(DeclarationExprAst *expr);
+	Flow assign(AssignExprAst *expr);
+	llvm::Constant *convert(ExprAst *expr, llvm::Constant *value, llvm::Type *type);
+	llvm::Type *type(TypeExprAst *expr);
+	bool allocate(ExprAst *site, uint64_t bytes);
+	void push_scope();
+	void pop_scope();
+	bool step(ExprAst *expr);
+	bool fail(ExprAst *expr, std::string message);
+};
+
+#endif
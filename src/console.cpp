@@ -0,0 +1,98 @@
+#include "console.hpp"
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+
+static thread_local ConsoleCapture *current = nullptr;
+
+// Appends to the `err` of a capture
+class CapturingErrors : public llvm::raw_ostream {
+private:
+	ConsoleCapture *capture;
+	uint64_t written = 0;
+public:
+	inline CapturingErrors(ConsoleCapture *capture)
+		: llvm::raw_ostream(true), capture(capture)
+	{}
+private:
+	inline void write_impl(const char *ptr, size_t size) override
+	{
+		std::lock_guard<std::mutex> lock(this->capture->lock);
+		this->capture->err.append(ptr, size);
+		this->written += size;
+	}
+
+	inline uint64_t current_pos() const override
+	{
+		return this->written;
+	}
+};
+
+static thread_local std::unique_ptr<CapturingErrors> errors; // Into `current->err`
+
+// Writes to the capture of the thread, or to the buffer `std::cout` had before
+class CapturingBuffer : public std::streambuf {
+private:
+	std::streambuf *stdout_buffer;
+public:
+	inline CapturingBuffer(std::streambuf *stdout_buffer)
+		: stdout_buffer(stdout_buffer)
+	{}
+protected:
+	inline int overflow(int c) override
+	{
+		if (c == traits_type::eof())
+			return traits_type::not_eof(c);
+		if (current) {
+			std::lock_guard<std::mutex> lock(current->lock);
+			current->out.push_back(traits_type::to_char_type(c));
+			return c;
+		}
+		return this->stdout_buffer->sputc(traits_type::to_char_type(c));
+	}
+
+	inline std::streamsize xsputn(const char *s, std::streamsize n) override
+	{
+		if (current) {
+			std::lock_guard<std::mutex> lock(current->lock);
+			current->out.append(s, n);
+			return n;
+		}
+		return this->stdout_buffer->sputn(s, n);
+	}
+
+	inline int sync() override
+	{
+		return current ? 0 : this->stdout_buffer->pubsync();
+	}
+};
+
+void install_console_capture()
+{
+	static std::once_flag installed;
+	std::call_once(installed, []() {
+		static CapturingBuffer buffer(std::cout.rdbuf());
+		std::cout.rdbuf(&buffer);
+	});
+}
+
+ConsoleCapture *set_console_capture(ConsoleCapture *capture)
+{
+	auto previous = current;
+	current = capture;
+	errors.reset(capture ? new CapturingErrors(capture) : nullptr);
+	return previous;
+}
+
+ConsoleCapture *console_capture()
+{
+	return current;
+}
+
+llvm::raw_ostream &console_errors()
+{
+	if (errors)
+		return *errors;
+	return llvm::errs();
+}
@@ -0,0 +1,28 @@
+#ifndef _CONSOLE_HPP_
+#define _CONSOLE_HPP_
+
+#include "llvm.hpp"
+#include <mutex>
+#include <string>
+
+/*
+ * Where the compiler's output goes, per thread. The server compiles the requests of many
+ * clients in one process, and each one gets back only what its own compile printed: while a
+ * thread has a capture, `std::cout` and `console_errors()` append to it instead of writing
+ * to stdout and stderr. Without a capture nothing changes.
+ */
+struct ConsoleCapture {
+	std::mutex lock; // The `-j N` workers of a request share its capture
+	std::string out;
+	std::string err;
+};
+
+// Puts the per thread buffer under `std::cout`, only the server needs it
+void install_console_capture();
+// For the calling thread, nullptr goes back to stdout and stderr. Returns the previous one.
+ConsoleCapture *set_console_capture(ConsoleCapture *capture);
+ConsoleCapture *console_capture();
+// `llvm::errs()`, or the capture of the calling thread
+llvm::raw_ostream &console_errors();
+
+#endif
@@ -0,0 +1,97 @@
+#include "debuginfo.hpp"
+#include <filesystem>
+
+DebugInfo::DebugInfo(llvm::Module &module, const std::string &source, DebugInfoKind kind, bool optimized)
+	: module(module), builder(module), kind(kind), optimized(optimized)
+{
+	auto path = std::filesystem::path(source);
+	auto directory = path.has_parent_path() ? path.parent_path().string() : std::filesystem::current_path().string();
+	this->file = this->builder.createFile(path.filename().string(), directory);
+
+	auto emission = kind == DebugInfoKind::Full ? llvm::DICompileUnit::FullDebug : llvm::DICompileUnit::LineTablesOnly;
+	this->unit = this->builder.createCompileUnit(llvm::dwarf::DW_LANG_C, this->file, "1337", optimized, "", 0, "",
+	                                             emission);
+
+	module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+	module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 5);
+}
+
+llvm::DISubprogram *DebugInfo::function(llvm::Function *function, SourceLocation loc)
+{
+	// Line tables don't describe any types, not even those of the function
+	std::vector<llvm::Metadata *> signature;
+	if (this->kind == DebugInfoKind::Full) {
+		auto type = function->getFunctionType();
+		signature.push_back(type->getReturnType()->isVoidTy() ? nullptr : this->type(type->getReturnType()));
+		for (auto param : type->params())
+			signature.push_back(this->type(param));
+	}
+
+	auto flags = llvm::DISubprogram::SPFlagDefinition;
+	if (this->optimized)
+		flags |= llvm::DISubprogram::SPFlagOptimized;
+	if (function->hasLocalLinkage())
+		flags |= llvm::DISubprogram::SPFlagLocalToUnit;
+
+	auto subprogram = this->builder.createFunction(this->unit, function->getName(), function->getName(), this->file,
+	                                               loc.line, this->builder.createSubroutineType(
+	                                                   this->builder.getOrCreateTypeArray(signature)),
+	                                               loc.line, llvm::DINode::FlagPrototyped, flags);
+	function->setSubprogram(subprogram);
+	return subprogram;
+}
+
+llvm::DILocation *DebugInfo::location(SourceLocation loc, llvm::DIScope *scope)
+{
+	return llvm::DILocation::get(this->module.getContext(), loc.line, loc.column, scope);
+}
+
+void DebugInfo::variable(llvm::AllocaInst *slot, const std::string &name, unsigned int argno, SourceLocation loc,
+                         llvm::DIScope *scope, llvm::BasicBlock *block)
+{
+	if (this->kind != DebugInfoKind::Full)
+		return;
+
+	auto type = this->type(slot->getAllocatedType());
+	auto variable = argno > 0 ?
+		this->builder.createParameterVariable(scope, name, argno, this->file, loc.line, type, this->optimized) :
+		this->builder.createAutoVariable(scope, name, this->file, loc.line, type, this->optimized);
+	this->builder.insertDeclare(slot, variable, this->builder.createExpression(), this->location(loc, scope), block);
+}
+
+void DebugInfo::finalize()
+{
+	this->builder.finalize();
+}
+
+llvm::DIType *DebugInfo::type(llvm::Type *type)
+{
+	if (auto known = this->types.find(type); known != this->types.end())
+		return known->second;
+
+	auto &data_layout = this->module.getDataLayout();
+	llvm::DIType *result;
+	if (type->isIntegerTy(1)) {
+		result = this->builder.createBasicType("bool", 8, llvm::dwarf::DW_ATE_boolean);
+	} else if (type->isIntegerTy()) {
+		auto bits = type->getIntegerBitWidth();
+		result = this->builder.createBasicType("i" + std::to_string(bits), bits, llvm::dwarf::DW_ATE_signed);
+	} else if (type->isFloatingPointTy()) {
+		auto bits = type->getPrimitiveSizeInBits().getFixedValue();
+		result = this->builder.createBasicType("f" + std::to_string(bits), bits, llvm::dwarf::DW_ATE_float);
+	} else if (type->isPointerTy()) {
+		result = this->builder.createPointerType(nullptr, data_layout.getPointerSizeInBits());
+	} else if (type->isSized()) {
+		auto name = llvm::isa<llvm::StructType>(type) && llvm::cast<llvm::StructType>(type)->hasName() ?
+			llvm::cast<llvm::StructType>(type)->getName().str() : std::string();
+		result = this->builder.createStructType(this->unit, name, this->file, 0,
+		                                        data_layout.getTypeAllocSizeInBits(type).getFixedValue(),
+		                                        data_layout.getABITypeAlign(type).value() * 8,
+		                                        llvm::DINode::FlagZero, nullptr, this->builder.getOrCreateArray({}));
+	} else {
+		result = this->builder.createUnspecifiedType("void");
+	}
+
+	this->types[type] = result;
+	return result;
+}
@@ -0,0 +1,54 @@
+#ifndef _DEBUGINFO_HPP_
+#define _DEBUGINFO_HPP_
+
+#include "llvm.hpp"
+#include "lexer.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+enum class DebugInfoKind: int {
+	None,
+	LineTables, // -gline-tables-only, functions and lines, enough for perf to symbolize
+	Full,       // -g, also the types of the functions and their parameters and locals
+};
+
+/*
+ * DWARF for a module, built with `llvm::DIBuilder`.
+ *
+ * There is one compile unit for the source file. Every function `Codegen` defines gets a
+ * subprogram, and its instructions get the line and column of the expression they were
+ * generated for. With `-g` the parameters and locals are described too, as `dbg.declare`s
+ * of their stack slots, which mem2reg turns into `dbg.value`s when it promotes them.
+ *
+ * Line tables are metadata only, the optimizer ignores them when it decides what to do, so
+ * `-gline-tables-only` leaves the generated code the same as without it.
+ *
+ * Types are described from the LLVM types: integers are signed (`i1` is a boolean), pointers
+ * point to nothing in particular, and structs only have their size. The helper functions of
+ * the runtime (reference counting, arenas) have no debug info, calls into them are
+ * attributed to the line of the caller.
+ */
+class DebugInfo {
+private:
+	llvm::Module &module;
+	llvm::DIBuilder builder;
+	DebugInfoKind kind;
+	bool optimized;
+	llvm::DIFile *file;
+	llvm::DICompileUnit *unit;
+	std::map<llvm::Type *, llvm::DIType *> types;
+public:
+	DebugInfo(llvm::Module &module, const std::string &source, DebugInfoKind kind, bool optimized);
+
+	llvm::DISubprogram *function(llvm::Function *function, SourceLocation loc);
+	llvm::DILocation *location(SourceLocation loc, llvm::DIScope *scope);
+	// Parameters are numbered from 1, 0 is a local
+	void variable(llvm::AllocaInst *slot, const std::string &name, unsigned int argno, SourceLocation loc,
+	              llvm::DIScope *scope, llvm::BasicBlock *block);
+	void finalize();
+private:
+	llvm::DIType *type(llvm::Type *type);
+};
+
+#endif
@@ -0,0 +1,379 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <set>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include <filesystem>
+#include "driver.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "reachability.hpp"
+#include "lto.hpp"
+#include "linker.hpp"
+
+// How top level expressions are called in the time report
+static std::string declaration_name(ExprAst *expr)
+{
+	if (auto decl = dynamic_cast<DeclarationExprAst *>(expr); decl != nullptr)
+		return decl->name->name;
+	if (auto ext = dynamic_cast<ExternExprAst *>(expr); ext != nullptr)
+		return "extern " + ext->decl->name->name;
+	return expr->source_loc().str();
+}
+
+// The number a flag ends with after `prefix`, prints an error if there's none or it's too big
+template <typename T>
+static bool parse_number(llvm::StringRef arg, size_t prefix, T &value)
+{
+	if (arg.substr(prefix).getAsInteger(10, value)) {
+		std::cout << "[ERR] Expected a number in '" << arg.str() << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Lexes, parses, generates and emits one file. Every file gets its own `Codegen` and with it
+// its own `LLVMContext`, so files share nothing and can be compiled on any thread. With an
+// `image` the object is emitted into it, for the in process link, instead of to `object`.
+static bool compile(const std::string &source, const std::string &object, const CodegenOptions &options, std::mutex &console,
+                    llvm::SmallVector<char, 0> *image = nullptr)
+{
+	auto report = options.time_report;
+	std::vector<std::unique_ptr<ExprAst>> exprs;
+
+	// The lexer runs token by token from the parser, its share is taken out of the parse span
+	PhaseSample lexing;
+	auto parsing = PhaseSample::now();
+	try {
+		auto parser = Parser(source, report ? &lexing : nullptr);
+		while (true) {
+			auto expr = parser.parse_expression();
+			if (!expr)
+				break;
+
+			exprs.push_back(std::move(expr));
+		}
+
+		if (!parser.is_finished()) {
+			std::lock_guard<std::mutex> lock(console);
+			std::cout << "[ERR] Failed to parse '" << source << "' until EOF" << std::endl;
+			return false;
+		}
+	} catch (const std::runtime_error &) {
+		std::lock_guard<std::mutex> lock(console);
+		std::cout << "[ERR] Failed to read '" << source << "'" << std::endl;
+		return false;
+	}
+	if (report) {
+		auto parse = PhaseSample::now() - parsing;
+		parse.wall_ns -= std::min(parse.wall_ns, lexing.wall_ns);
+		parse.cpu_ns -= std::min(parse.cpu_ns, lexing.cpu_ns);
+		parse.allocations -= lexing.allocations;
+		parse.allocated_bytes -= lexing.allocated_bytes;
+		report->record({ "phase", "parse", source, parsing.wall_ns, parse });
+		report->record({ "phase", "lex", source, parsing.wall_ns + parse.wall_ns, lexing });
+	}
+
+	// Declarations nothing uses are dropped before codegen ever sees them
+	if (options.lazy) {
+		PhaseTimer timer(report, "phase", "reachability", source);
+		Reachability reachability;
+		for (auto &expr : exprs)
+			reachability.index(expr.get());
+
+		std::vector<std::unique_ptr<ExprAst>> reached;
+		for (auto &expr : exprs) {
+			if (reachability.is_reached(expr.get()))
+				reached.push_back(std::move(expr));
+		}
+		exprs = std::move(reached);
+	}
+
+	auto codegen = Codegen(options, source);
+
+	// Functions can be called before their definition. Declaring them is as close as this
+	// compiler gets to a semantic analysis: types, struct layouts and prototypes are resolved.
+	bool failed = false;
+	std::optional<PhaseTimer> phase;
+	phase.emplace(report, "phase", "declare", source);
+	for (auto &expr : exprs) {
+		PhaseTimer timer(report, "decl", report ? "declare " + declaration_name(expr.get()) : "", source);
+		if (!codegen.predeclare(expr.get())) {
+			std::lock_guard<std::mutex> lock(console);
+			std::cout << "[ERR] Failed to declare the following expression: "
+				<< expr->to_string() << std::endl;
+			failed = true;
+		}
+	}
+
+	phase.emplace(report, "phase", "generate", source);
+	for (auto &expr : exprs) {
+		PhaseTimer timer(report, "decl", report ? "generate " + declaration_name(expr.get()) : "", source);
+		if (!codegen.include(expr.get())) {
+			std::lock_guard<std::mutex> lock(console);
+			std::cout << "[ERR] Failed to codegen the following expression: "
+				<< expr->to_string() << std::endl;
+			failed = true;
+		}
+	}
+
+	phase.reset();
+
+	// The module is incomplete, there's nothing to emit
+	if (failed)
+		return false;
+	phase.emplace(report, "phase", "optimize", source);
+	codegen.optimize();
+
+	// Printing the IR of a big program takes longer than generating it, so it's only done on request
+	if (options.dump_ir || options.dump_asm) {
+		phase.emplace(report, "phase", "dump", source);
+		std::lock_guard<std::mutex> lock(console);
+		codegen.dump();
+	}
+	if (options.dump_bitcode && options.lto == LtoMode::None) {
+		phase.emplace(report, "phase", "dump", source);
+		if (!codegen.write_bitcode(std::filesystem::path(object).replace_extension(".bc").string()))
+			return false;
+	}
+
+	phase.emplace(report, "phase", "emit", source);
+	if (options.lto != LtoMode::None)
+		return codegen.write_bitcode(object);
+	if (image) {
+		llvm::raw_svector_ostream stream(*image);
+		return codegen.emit_object(stream);
+	}
+	return codegen.write_object(object);
+}
+
+int run_compiler(Invocation &invocation)
+{
+	CodegenOptions options;
+	std::vector<std::string> sources;
+	std::string output;
+	size_t jobs = 1;
+	bool opt_level_given = false;
+	bool time_report = false;
+	std::string time_trace;
+	auto &args = invocation.args;
+	auto argc = args.size();
+
+	for (size_t i = 0; i < argc; ++i) {
+		auto &arg = args[i];
+		if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && arg[2] >= '0' && arg[2] <= '3') {
+			options.opt_level = arg[2] - '0';
+			opt_level_given = true;
+		} else if (arg.rfind("-Rpass=", 0) == 0)
+			options.remarks = arg.substr(7);
+		else if (arg.rfind("-Rpass-missed=", 0) == 0)
+			options.missed_remarks = arg.substr(14);
+		else if (arg.rfind("-fcleanup-inline-threshold=", 0) == 0) {
+			if (!parse_number(arg, 27, options.cleanup_inline_threshold))
+				return 1;
+		} else if (arg == "-foverflow=wrap")
+			options.overflow = OverflowMode::Wrap;
+		else if (arg == "-foverflow=trap")
+			options.overflow = OverflowMode::Trap;
+		else if (arg == "-foverflow=assume-none")
+			options.overflow = OverflowMode::AssumeNone;
+		else if (arg == "-fdump-struct-layouts")
+			options.dump_struct_layouts = true;
+		else if (arg == "-fdump-ir")
+			options.dump_ir = true;
+		else if (arg == "-fdump-asm")
+			options.dump_asm = true;
+		else if (arg == "-fdump-bitcode")
+			options.dump_bitcode = true;
+		else if (arg == "-target" && i + 1 < argc)
+			options.triple = args[++i];
+		else if (arg.rfind("--target=", 0) == 0)
+			options.triple = arg.substr(9);
+		else if (arg.rfind("-fcomptime-steps=", 0) == 0) {
+			if (!parse_number(arg, 17, options.comptime_steps))
+				return 1;
+		} else if (arg.rfind("-fcomptime-memory=", 0) == 0) {
+			if (!parse_number(arg, 18, options.comptime_memory))
+				return 1;
+		}
+		else if (arg == "-flazy")
+			options.lazy = true;
+		else if (arg == "-flto" || arg == "-flto=full")
+			options.lto = LtoMode::Full;
+		else if (arg == "-flto=thin")
+			options.lto = LtoMode::Thin;
+		else if (arg == "-fprofile-generate")
+			options.profile_generate = "default_%m.profraw";
+		else if (arg.rfind("-fprofile-generate=", 0) == 0)
+			options.profile_generate = arg.substr(19);
+		else if (arg.rfind("-fprofile-use=", 0) == 0)
+			options.profile_use = arg.substr(14);
+		else if (arg == "-g")
+			options.debug_info = DebugInfoKind::Full;
+		else if (arg == "-gline-tables-only")
+			options.debug_info = DebugInfoKind::LineTables;
+		else if (arg == "-finstrument")
+			options.instrument = true;
+		else if (arg == "-ftime-report")
+			time_report = true;
+		else if (arg.rfind("-ftime-trace=", 0) == 0)
+			time_trace = arg.substr(13);
+		else if (arg == "-o" && i + 1 < argc)
+			output = args[++i];
+		else if (arg == "-j" && i + 1 < argc) {
+			if (!parse_number(args[++i], 0, jobs))
+				return 1;
+		} else if (arg.size() > 2 && arg.rfind("-j", 0) == 0) {
+			if (!parse_number(arg, 2, jobs))
+				return 1;
+		} else
+			sources.push_back(arg);
+	}
+
+	if (sources.empty()) {
+		std::cout << "usage: 1337 [-O0|-O1|-O2|-O3] [-Rpass=REGEX] [-Rpass-missed=REGEX] [-fcleanup-inline-threshold=N] [-foverflow=wrap|trap|assume-none] [-fdump-struct-layouts] [-fdump-ir] [-fdump-asm] [-fdump-bitcode] [-target TRIPLE] [-fcomptime-steps=N] [-fcomptime-memory=BYTES] [-flazy] [-flto[=full|thin]] [-fprofile-generate[=FILE]] [-fprofile-use=FILE] [-g|-gline-tables-only] [-finstrument] [-ftime-report] [-ftime-trace=FILE] [-j N] [-o OBJECT.o|PROGRAM] SOURCE... | BITCODE..." << std::endl;
+		return 1;
+	}
+
+	// The server's clients each have their own working directory, the server has none
+	auto resolve = [&](std::string &path) {
+		if (!path.empty() && !invocation.cwd.empty())
+			path = (invocation.cwd / path).lexically_normal().string();
+	};
+	for (auto &source : sources)
+		resolve(source);
+	resolve(output);
+	resolve(options.profile_use);
+	resolve(time_trace);
+	invocation.inputs = sources;
+	if (!options.profile_use.empty())
+		invocation.inputs.push_back(options.profile_use);
+	invocation.deterministic = !time_report && time_trace.empty();
+
+	// The instrumented build is the one collecting the profile, it can't use one yet
+	if (!options.profile_generate.empty() && !options.profile_use.empty()) {
+		std::cout << "[ERR] -fprofile-generate and -fprofile-use can't be combined" << std::endl;
+		return 1;
+	}
+	if (!options.profile_use.empty() && !std::filesystem::exists(options.profile_use)) {
+		std::cout << "[ERR] Profile '" << options.profile_use << "' doesn't exist, merge the .profraw files with llvm-profdata first" << std::endl;
+		return 1;
+	}
+
+	if (!initialize_target(target_triple(options))) {
+		std::cout << "[ERR] No backend for target '" << options.triple << "', only the native one is linked unless the compiler is built with -DLLVM_TARGETS=all" << std::endl;
+		return 1;
+	}
+
+	// `-j 0` uses every core
+	if (jobs == 0)
+		jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// The report is written once everything else is done
+	std::optional<TimeReport> report;
+	if (time_report || !time_trace.empty())
+		options.time_report = &report.emplace();
+	auto finish = [&](bool succeeded) {
+		if (time_report)
+			report->print();
+		if (!time_trace.empty() && !report->write_trace(time_trace))
+			succeeded = false;
+		return succeeded ? 0 : 1;
+	};
+
+	// Bitcode from `-flto` compiles is linked, merged and optimized as a whole
+	auto is_bitcode = [](const std::string &path) { return std::filesystem::path(path).extension() == ".bc"; };
+	if (std::all_of(sources.begin(), sources.end(), is_bitcode)) {
+		// ThinLTO names the objects after the inputs, only the link step knows them
+		invocation.deterministic = false;
+		if (output.empty()) {
+			output = "output.o";
+			resolve(output);
+		}
+		// The link is where LTO optimizes, without -O it's not meant to be skipped
+		if (!opt_level_given)
+			options.opt_level = 2;
+		bool linked;
+		{
+			PhaseTimer timer(options.time_report, "phase", "link", output);
+			linked = LinkTimeOptimizer(options, jobs).link(sources, output, invocation.cwd);
+		}
+		return finish(linked);
+	}
+	if (std::any_of(sources.begin(), sources.end(), is_bitcode)) {
+		std::cout << "[ERR] Sources and bitcode can't be mixed, compile the sources with -flto first" << std::endl;
+		return 1;
+	}
+
+	// `-o` with anything but an object links the files into an executable, their objects stay in memory
+	auto extension = options.lto != LtoMode::None ? ".bc" : ".o";
+	auto output_extension = std::filesystem::path(output).extension();
+	auto executable = !output.empty() && options.lto == LtoMode::None && output_extension != ".o" && output_extension != ".bc";
+	if (executable && !options.profile_generate.empty()) {
+		std::cout << "[ERR] -fprofile-generate needs compiler-rt's profile runtime, write an object (-o NAME.o) and link it with clang -fprofile-generate" << std::endl;
+		return 1;
+	}
+
+	// A single file goes to `-o` (or `output.o`), otherwise every file gets an object named after it
+	std::vector<std::string> objects;
+	if (sources.size() == 1 && !executable) {
+		objects.push_back(output.empty() ? std::string("output") + extension : output);
+		resolve(objects.back());
+	} else if (!output.empty() && !executable) {
+		std::cout << "[ERR] -o OBJECT only works with a single source, every source gets its own object" << std::endl;
+		return 1;
+	} else {
+		std::set<std::string> seen;
+		for (auto &source : sources) {
+			auto object = std::filesystem::path(source).stem().string() + extension;
+			if (!seen.insert(object).second) {
+				std::cout << "[ERR] More than one source would be written to '" << object << "'" << std::endl;
+				return 1;
+			}
+			objects.push_back(object);
+			resolve(objects.back());
+		}
+	}
+	invocation.outputs = executable ? std::vector<std::string> { output } : objects;
+	if (options.dump_bitcode && options.lto == LtoMode::None) {
+		for (auto &object : objects)
+			invocation.outputs.push_back(std::filesystem::path(object).replace_extension(".bc").string());
+	}
+
+	jobs = std::min(jobs, sources.size());
+
+	// Each worker takes the next file until none are left
+	std::atomic<size_t> next = 0;
+	std::atomic<bool> failed = false;
+	std::vector<llvm::SmallVector<char, 0>> images(executable ? sources.size() : 0);
+	std::mutex console;
+	auto capture = console_capture();
+	auto worker = [&]() {
+		set_console_capture(capture);
+		for (size_t i = next++; i < sources.size(); i = next++) {
+			if (!compile(sources[i], objects[i], options, console, executable ? &images[i] : nullptr))
+				failed = true;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < jobs; ++i)
+		workers.emplace_back(worker);
+	worker();
+	for (auto &thread : workers)
+		thread.join();
+
+	if (executable && !failed) {
+		PhaseTimer timer(options.time_report, "phase", "link", output);
+		failed = !Linker(options).link(images, output);
+	}
+
+	return finish(!failed);
+}
@@ -0,0 +1,20 @@
+#ifndef _DRIVER_HPP_
+#define _DRIVER_HPP_
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// One run of the compiler, for the command line or for a client of the server
+struct Invocation {
+	std::vector<std::string> args; // Without the program name
+	std::filesystem::path cwd; // The paths in `args` are relative to it, to the current directory when empty
+	std::vector<std::string> inputs; // Filled in by `run_compiler`, the files it reads
+	std::vector<std::string> outputs; // and the ones it writes
+	bool deterministic = true; // The outputs only depend on the arguments and the contents of the inputs
+};
+
+// Parses the arguments, compiles and returns the exit code
+int run_compiler(Invocation &invocation);
+
+#endif
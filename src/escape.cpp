@@ -0,0 +1,181 @@
+#include "escape.hpp"
+#include "refcount.hpp"
+#include <vector>
+
+static bool is_free(llvm::Value *value)
+{
+	auto call = llvm::dyn_cast<llvm::CallBase>(value);
+	return call && call->getCalledFunction() && call->getCalledFunction()->getName() == "free";
+}
+
+// Only the allocating function (the owner) may free the object, it will stop
+// doing so once the object lives in its stack frame.
+bool HeapToStackPass::escapes(llvm::Value *value, bool owner, std::set<llvm::Value *> &visited)
+{
+	if (!visited.insert(value).second)
+		return false;
+
+	for (auto &use : value->uses()) {
+		auto user = use.getUser();
+
+		if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user))
+			continue;
+
+		if (auto store = llvm::dyn_cast<llvm::StoreInst>(user); store != nullptr) {
+			if (store->getPointerOperand() != value)
+				return true;
+			continue;
+		}
+
+		if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(user); gep != nullptr) {
+			if (this->escapes(gep, owner, visited))
+				return true;
+			continue;
+		}
+
+		if (auto call = llvm::dyn_cast<llvm::CallBase>(user); call != nullptr) {
+			auto op = RcRuntime::classify(call).second;
+			if (op == RcOp::Retain) {
+				if (this->escapes(call, owner, visited))
+					return true;
+				continue;
+			}
+			if (op == RcOp::Release || is_free(call)) {
+				if (!owner)
+					return true;
+				continue;
+			}
+
+			// The frame is gone once a guaranteed tail call runs
+			auto callee = call->getCalledFunction();
+			if (!callee || !call->isArgOperand(&use) || call->isMustTailCall())
+				return true;
+
+			auto argno = call->getArgOperandNo(&use);
+			if (callee->isDeclaration()) {
+				if (!call->doesNotCapture(argno) || !callee->hasFnAttribute(llvm::Attribute::NoFree))
+					return true;
+				continue;
+			}
+
+			if (callee->isVarArg() || this->escapes(callee->getArg(argno), false, visited))
+				return true;
+			continue;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void HeapToStackPass::promote(llvm::CallBase *alloc, uint64_t size, bool zeroed)
+{
+	auto function = alloc->getFunction();
+	auto &entry = function->getEntryBlock();
+	auto builder = llvm::IRBuilder<>(&entry, entry.getFirstInsertionPt());
+	auto slot = builder.CreateAlloca(llvm::ArrayType::get(builder.getInt8Ty(), size), nullptr, "heap2stack");
+	slot->setAlignment(llvm::Align(16));
+
+	if (zeroed) {
+		builder.SetInsertPoint(alloc);
+		builder.CreateMemSet(slot, builder.getInt8(0), size, llvm::MaybeAlign(16));
+	}
+
+	// Reference counting and freeing only ever happens on the object itself or on
+	// retained copies of it, which are the very same pointer
+	std::vector<llvm::Value *> worklist = { alloc };
+	std::vector<llvm::Instruction *> dead;
+	while (!worklist.empty()) {
+		auto value = worklist.back();
+		worklist.pop_back();
+		for (auto user : value->users()) {
+			auto op = RcRuntime::classify(user).second;
+			if (op == RcOp::Retain) {
+				worklist.push_back(user);
+				dead.push_back(llvm::cast<llvm::Instruction>(user));
+			} else if (op == RcOp::Release || is_free(user)) {
+				dead.push_back(llvm::cast<llvm::Instruction>(user));
+			} else if (llvm::isa<llvm::GetElementPtrInst>(user)) {
+				worklist.push_back(user);
+			}
+		}
+	}
+
+	for (auto inst : dead) {
+		if (!inst->getType()->isVoidTy())
+			inst->replaceAllUsesWith(slot);
+	}
+	for (auto inst : dead)
+		inst->eraseFromParent();
+
+	alloc->replaceAllUsesWith(slot);
+	alloc->eraseFromParent();
+}
+
+llvm::PreservedAnalyses HeapToStackPass::run(llvm::Module &module, llvm::ModuleAnalysisManager &mam)
+{
+	auto &layout = module.getDataLayout();
+	bool changed = false;
+
+	for (auto &function : module) {
+		if (function.isDeclaration())
+			continue;
+
+		std::vector<std::pair<llvm::CallBase *, bool>> allocs;
+		for (auto &block : function) {
+			for (auto &inst : block) {
+				auto call = llvm::dyn_cast<llvm::CallBase>(&inst);
+				if (!call || !call->getCalledFunction())
+					continue;
+
+				if (call->getCalledFunction()->getName() == "malloc")
+					allocs.push_back({ call, false });
+				else if (RcRuntime::classify(call).second == RcOp::Alloc)
+					allocs.push_back({ call, true });
+			}
+		}
+
+		if (allocs.empty())
+			continue;
+
+		size_t promoted = 0;
+		for (auto [alloc, zeroed] : allocs) {
+			auto size = llvm::dyn_cast<llvm::Constant>(alloc->getArgOperand(0));
+			if (size)
+				size = llvm::ConstantFoldConstant(size, layout);
+
+			auto known_size = llvm::dyn_cast_or_null<llvm::ConstantInt>(size);
+			if (!known_size || known_size->getZExtValue() > HeapToStackPass::max_size)
+				continue;
+
+			std::set<llvm::Value *> visited;
+			if (this->escapes(alloc, true, visited))
+				continue;
+
+			this->promote(alloc, known_size->getZExtValue(), zeroed);
+			++promoted;
+		}
+
+		llvm::OptimizationRemarkEmitter remarks(&function);
+		if (promoted > 0) {
+			remarks.emit([&]() {
+				return llvm::OptimizationRemark("heap-to-stack", "Promoted", &function)
+					<< "promoted " << llvm::ore::NV("Promoted", promoted) << " of "
+					<< llvm::ore::NV("Allocations", allocs.size()) << " heap allocations to the stack in '"
+					<< function.getName() << "'";
+			});
+		}
+		if (promoted < allocs.size()) {
+			remarks.emit([&]() {
+				return llvm::OptimizationRemarkMissed("heap-to-stack", "Escapes", &function)
+					<< llvm::ore::NV("Kept", allocs.size() - promoted)
+					<< " heap allocations escape or have an unknown size in '" << function.getName() << "'";
+			});
+		}
+
+		changed |= promoted > 0;
+	}
+
+	return changed ? llvm::PreservedAnalyses::none() : llvm::PreservedAnalyses::all();
+}
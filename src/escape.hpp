@@ -0,0 +1,26 @@
+#ifndef _ESCAPE_HPP_
+#define _ESCAPE_HPP_
+
+#include "llvm.hpp"
+#include <set>
+
+/*
+ * Escape analysis for `alloc<T>()`, `rcalloc<T>()` and `arcalloc<T>()`.
+ *
+ * An allocation of known size that never outlives its function (it's not stored into
+ * memory, returned, or handed to code that keeps it) is rewritten into an entry block
+ * `alloca`. Its `free` and reference counting calls go away with it.
+ *
+ * Reports under `-Rpass=heap-to-stack` (and `-Rpass-missed=heap-to-stack`).
+ */
+class HeapToStackPass : public llvm::PassInfoMixin<HeapToStackPass> {
+public:
+	static constexpr uint64_t max_size = 4096; // Bigger allocations stay on the heap, the stack is small
+public:
+	llvm::PreservedAnalyses run(llvm::Module &module, llvm::ModuleAnalysisManager &mam);
+private:
+	bool escapes(llvm::Value *value, bool owner, std::set<llvm::Value *> &visited);
+	void promote(llvm::CallBase *alloc, uint64_t size, bool zeroed);
+};
+
+#endif
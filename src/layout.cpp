@@ -0,0 +1,134 @@
+#include "layout.hpp"
+#include <algorithm>
+#include <iomanip>
+
+static uint64_t align_to(uint64_t offset, uint64_t align)
+{
+	return (offset + align - 1) / align * align;
+}
+
+void StructLayout::compute(llvm::LLVMContext &context, const llvm::DataLayout &data_layout)
+{
+	std::vector<int> hot, cold;
+	for (size_t i = 0; i < this->fields.size(); ++i)
+		(this->fields[i].cold ? cold : hot).push_back(i);
+
+	auto ptr_type = llvm::PointerType::get(context, 0);
+	if (!cold.empty()) {
+		hot.push_back(-1);
+		this->cold.type = llvm::StructType::create(context, this->name + ".cold");
+		this->place(this->cold, cold, ptr_type, data_layout);
+	}
+
+	this->place(this->hot, hot, ptr_type, data_layout);
+}
+
+void StructLayout::place(StructPart &part, std::vector<int> fields, llvm::Type *ptr_type, const llvm::DataLayout &data_layout)
+{
+	auto ptr_size = data_layout.getTypeAllocSize(ptr_type).getFixedValue();
+	auto ptr_align = data_layout.getABITypeAlign(ptr_type).value();
+	auto size_of = [&](int i) { return i < 0 ? ptr_size : this->fields[i].size; };
+	auto align_of = [&](int i) -> uint64_t {
+		if (i < 0)
+			return this->packed ? 1 : ptr_align;
+		auto &field = this->fields[i];
+		return std::max<uint64_t>(this->packed ? 1 : field.natural_align, field.align);
+	};
+
+	if (!this->packed) {
+		std::stable_sort(fields.begin(), fields.end(), [&](int a, int b) {
+			return align_of(a) > align_of(b);
+		});
+	}
+
+	std::vector<llvm::Type *> elements;
+	auto i8_type = llvm::Type::getInt8Ty(ptr_type->getContext());
+	uint64_t offset = 0;
+	uint64_t used = 0;
+	for (auto i : fields) {
+		auto align = align_of(i);
+		part.align = std::max(part.align, align);
+
+		auto start = align_to(offset, align);
+		if (start > offset)
+			elements.push_back(llvm::ArrayType::get(i8_type, start - offset));
+
+		elements.push_back(i < 0 ? ptr_type : this->fields[i].type);
+		if (i < 0) {
+			this->cold_index = elements.size() - 1;
+			this->cold_offset = start;
+		} else {
+			auto &field = this->fields[i];
+			field.index = elements.size() - 1;
+			field.offset = start;
+		}
+
+		part.slots.push_back(StructSlot { i, start, size_of(i) });
+		offset = start + size_of(i);
+		used += size_of(i);
+		// Nothing else goes into the rest of an `@align(N)` field's block
+		if (i >= 0 && this->fields[i].align)
+			offset = align_to(offset, this->fields[i].align);
+	}
+
+	// The fields can rely on the alignment of the whole part, which is only known now
+	for (auto i : fields) {
+		if (i >= 0)
+			this->fields[i].access_align = llvm::commonAlignment(llvm::Align(part.align), this->fields[i].offset).value();
+	}
+
+	part.size = align_to(offset, part.align);
+	if (part.size > offset)
+		elements.push_back(llvm::ArrayType::get(i8_type, part.size - offset));
+	part.padding = part.size - used;
+	part.type->setBody(elements, true);
+}
+
+StructField *StructLayout::field(const std::string &name)
+{
+	for (auto &field : this->fields) {
+		if (field.name == name)
+			return &field;
+	}
+
+	return nullptr;
+}
+
+void StructLayout::print(std::ostream &out)
+{
+	auto print_part = [&](StructPart &part) {
+		auto row = [&](uint64_t offset, uint64_t size, std::string what) {
+			out << "  " << std::setw(6) << offset << " " << std::setw(6) << size << "  " << what << "\n";
+		};
+
+		out << "  offset   size  field\n";
+		uint64_t offset = 0;
+		for (auto &slot : part.slots) {
+			std::string what = "(cold fields): ptr";
+			if (slot.field >= 0) {
+				auto &field = this->fields[slot.field];
+				what = field.name + ": " + field.spelling;
+				if (field.align)
+					what += " @align(" + std::to_string(field.align) + ")";
+			}
+
+			if (slot.offset > offset)
+				row(offset, slot.offset - offset, "(padding)");
+			row(slot.offset, slot.size, what);
+			offset = slot.offset + slot.size;
+		}
+
+		if (part.size > offset)
+			row(offset, part.size - offset, "(padding)");
+	};
+
+	out << "struct " << this->name << (this->packed ? " @packed" : "") << ": " << this->hot.size << " bytes, align " <<
+		this->hot.align << ", " << this->hot.padding << " bytes padding\n";
+	print_part(this->hot);
+
+	if (this->cold.type) {
+		out << "struct " << this->name << " (cold part): " << this->cold.size << " bytes, align " <<
+			this->cold.align << ", " << this->cold.padding << " bytes padding\n";
+		print_part(this->cold);
+	}
+}
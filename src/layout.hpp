@@ -0,0 +1,68 @@
+#ifndef _LAYOUT_HPP_
+#define _LAYOUT_HPP_
+
+#include "llvm.hpp"
+#include "ast.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+
+struct StructField {
+	std::string name;
+	std::string spelling; // The type as written, for the layout printout
+	TypeExprAst *decl; // The type as written
+	llvm::Type *type;
+	uint64_t size;
+	uint64_t natural_align;
+	unsigned int align = 0; // `@align(N)`, 0 if not given
+	bool cold = false;
+	unsigned int index = 0; // Element of the hot or the cold LLVM struct
+	uint64_t offset = 0;
+	uint64_t access_align = 1; // What loads and stores of the field can rely on
+};
+
+struct StructSlot {
+	int field; // Index into the fields, -1 is the pointer to the cold part
+	uint64_t offset;
+	uint64_t size;
+};
+
+// One of the two blocks of memory a struct lives in
+struct StructPart {
+	llvm::StructType *type = nullptr;
+	uint64_t size = 0;
+	uint64_t align = 1;
+	uint64_t padding = 0;
+	std::vector<StructSlot> slots; // By offset
+};
+
+/*
+ * Where the fields of a struct go. The layout is computed here and not left to LLVM:
+ * the LLVM struct is packed with explicit padding arrays, so what `-fdump-struct-layouts`
+ * prints is exactly what the code uses.
+ *
+ * - By default the fields are sorted by alignment, biggest first, which leaves no
+ *   padding between them for the power of two alignments of our types.
+ * - `@packed` keeps the declaration order and drops all padding.
+ * - `@align(N)` starts the field at a multiple of N and pads it to the next one, so a
+ *   contended field gets its cache line to itself.
+ * - `@cold` fields move to a second struct that the hot part points to, allocated out of
+ *   line together with it. The hot fields pack tighter and more of them fit a cache line.
+ */
+struct StructLayout {
+	std::string name;
+	bool packed = false;
+	std::vector<StructField> fields; // In declaration order
+	StructPart hot;
+	StructPart cold; // `cold.type` is `nullptr` if there are no `@cold` fields
+	unsigned int cold_index = 0; // Element of the hot part pointing to the cold part
+	uint64_t cold_offset = 0;
+
+	void compute(llvm::LLVMContext &context, const llvm::DataLayout &data_layout);
+	StructField *field(const std::string &name);
+	void print(std::ostream &out);
+private:
+	void place(StructPart &part, std::vector<int> fields, llvm::Type *ptr_type, const llvm::DataLayout &data_layout);
+};
+
+#endif
@@ -36,13 +36,22 @@ Lexer::tokenize()
 {
 	Token token;
 
-	static std::unordered_map<std::string, TokenType> keywords = {
+	static const std::unordered_map<std::string, TokenType> keywords = {
 		{ "fn", TokenType::Fn },
 		{ "mut", TokenType::Mut },
-		{ "extern", TokenType::Extern }
+		{ "extern", TokenType::Extern },
+		{ "pub", TokenType::Pub },
+		{ "arena", TokenType::Arena },
+		{ "defer", TokenType::Defer },
+		{ "return", TokenType::Return },
+		{ "become", TokenType::Become },
+		{ "if", TokenType::If },
+		{ "else", TokenType::Else },
+		{ "struct", TokenType::Struct },
+		{ "comptime", TokenType::Comptime }
 	};
 
-	static std::unordered_map<char, TokenType> symbols = {
+	static const std::unordered_map<char, TokenType> symbols = {
 		{ '{', TokenType::LeftCurly },
 		{ '}', TokenType::RightCurly },
 		{ '(', TokenType::LeftParen },
@@ -51,11 +60,25 @@ Lexer::tokenize()
 		{ ']', TokenType::RightBracket },
 		{ ',', TokenType::Comma },
 		{ ':', TokenType::Colon },
+		{ '.', TokenType::Dot },
+		{ '@', TokenType::At },
 		{ '+', TokenType::Plus },
 		{ '-', TokenType::Minus },
 		{ '/', TokenType::Divide },
 		{ '*', TokenType::Multiply },
 		{ '=', TokenType::Equals },
+		{ '<', TokenType::Less },
+		{ '>', TokenType::Greater },
+	};
+
+	static const std::unordered_map<std::string, TokenType> compound_symbols = {
+		{ "==", TokenType::EqualsEquals },
+		{ "!=", TokenType::NotEquals },
+		{ "<=", TokenType::LessEquals },
+		{ ">=", TokenType::GreaterEquals },
+		{ "+%", TokenType::WrappingPlus },
+		{ "-%", TokenType::WrappingMinus },
+		{ "*%", TokenType::WrappingMultiply },
 	};
 
 	while (this->cursor < this->content.length()) {
@@ -67,10 +90,17 @@ Lexer::tokenize()
 			continue;
 		}
 
+		// Handle comments
+		if (c == '#') {
+			while (this->advance() < this->content.length() && this->content[this->cursor] != '\n');
+			continue;
+		}
+
 		token.loc = this->loc;
 
-		// Handle numbers
-		if (std::isdigit(c) || c == '.') {
+		// Handle numbers, a dot that isn't followed by a digit accesses a field
+		if (std::isdigit(c) || (c == '.' && this->cursor + 1 < this->content.length() &&
+		                        std::isdigit(this->content[this->cursor + 1]))) {
 			token.type = TokenType::Integer;
 			for (; this->cursor < this->content.length(); this->advance()) {
 				auto next = content[this->cursor];
@@ -100,8 +130,8 @@ Lexer::tokenize()
 				token.value.push_back(next);
 			}
 
-			if (keywords.find(token.value) != keywords.end())
-				token.type = keywords[token.value];
+			if (auto keyword = keywords.find(token.value); keyword != keywords.end())
+				token.type = keyword->second;
 
 			return std::make_unique<Token>(token);
 		}
@@ -138,9 +168,19 @@ Lexer::tokenize()
 			return std::make_unique<Token>(token);
 		}
 
+		// Handle two character symbols, at the end of the input `substr` returns a single one
+		auto compound = compound_symbols.find(this->content.substr(this->cursor, 2));
+		if (compound != compound_symbols.end()) {
+			token.value = compound->first;
+			token.type = compound->second;
+			this->advance();
+			this->advance();
+			return std::make_unique<Token>(token);
+		}
+
 		// Handle symbols
-		if (symbols.find(c) != symbols.end()) {
-			token.type = symbols[c];
+		if (auto symbol = symbols.find(c); symbol != symbols.end()) {
+			token.type = symbol->second;
 			token.value = std::string(1, c);
 			this->advance();
 			return std::make_unique<Token>(token);
@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <sstream>
+#include <utility>
 
 struct SourceLocation {
 	std::string filepath = "<memory>";
@@ -36,6 +37,15 @@ enum class TokenType: int {
 	Fn,
 	Mut,
 	Extern,
+	Pub,
+	Arena,
+	Defer,
+	Return,
+	Become,
+	If,
+	Else,
+	Struct,
+	Comptime,
 
 	// Symbols
 	LeftCurly,
@@ -46,11 +56,22 @@ enum class TokenType: int {
 	RightBracket,
 	Comma,
 	Colon,
+	Dot,
+	At,
 	Plus,
 	Minus,
 	Divide,
 	Multiply,
 	Equals,
+	Less,
+	Greater,
+	EqualsEquals,
+	NotEquals,
+	LessEquals,
+	GreaterEquals,
+	WrappingPlus,
+	WrappingMinus,
+	WrappingMultiply,
 };
 
 struct Token {
@@ -70,6 +91,20 @@ public:
 public:
 	std::unique_ptr<Token>
 	tokenize();
+
+	// Position to rewind to, for the few places of the grammar that need to look ahead
+	inline std::pair<size_t, SourceLocation>
+	save()
+	{
+		return { this->cursor, this->loc };
+	}
+
+	inline void
+	restore(std::pair<size_t, SourceLocation> state)
+	{
+		this->cursor = state.first;
+		this->loc = state.second;
+	}
 private:
 	inline size_t
 	advance()
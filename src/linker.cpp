@@ -0,0 +1,123 @@
+#include "linker.hpp"
+#include "console.hpp"
+#include <mutex>
+#include <iostream>
+#include <unistd.h>
+#include <link.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+
+#ifdef _1337_LLD
+#include <lld/Common/Driver.h>
+
+LLD_HAS_DRIVER(elf)
+
+// PT_INTERP of the running compiler, the program is linked against the same C library
+static std::string dynamic_loader()
+{
+	auto headers = reinterpret_cast<const ElfW(Phdr) *>(getauxval(AT_PHDR));
+	auto count = getauxval(AT_PHNUM);
+	ElfW(Addr) base = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (headers[i].p_type == PT_PHDR)
+			base = reinterpret_cast<ElfW(Addr)>(headers) - headers[i].p_vaddr;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (headers[i].p_type == PT_INTERP)
+			return reinterpret_cast<const char *>(base + headers[i].p_vaddr);
+	}
+	return "";
+}
+
+// Closes the memfds once LLD is done with them
+struct MemoryFiles {
+	std::vector<int> fds;
+
+	inline ~MemoryFiles()
+	{
+		for (auto fd : this->fds)
+			close(fd);
+	}
+};
+#endif
+
+bool Linker::link(const std::vector<llvm::SmallVector<char, 0>> &objects, const std::string &output)
+{
+#ifndef _1337_LLD
+	std::cout << "[ERR] The compiler was built without LLD, -o can only write an object (.o)" << std::endl;
+	return false;
+#else
+	if (!this->options.triple.empty() && target_triple(this->options) != llvm::sys::getDefaultTargetTriple()) {
+		std::cout << "[ERR] Only programs for the host can be linked, write an object (-o NAME.o) for -target" << std::endl;
+		return false;
+	}
+	auto loader = dynamic_loader();
+	if (loader.empty()) {
+		std::cout << "[ERR] The compiler is linked statically, there's no dynamic loader to link the program against" << std::endl;
+		return false;
+	}
+
+	MemoryFiles files;
+	std::vector<std::string> paths;
+	for (auto &object : objects) {
+		auto fd = memfd_create("1337-object", MFD_CLOEXEC);
+		if (fd < 0) {
+			std::cout << "[ERR] Failed to create a memfd for an object" << std::endl;
+			return false;
+		}
+		files.fds.push_back(fd);
+
+		for (size_t written = 0; written < object.size();) {
+			auto n = write(fd, object.data() + written, object.size() - written);
+			if (n <= 0) {
+				std::cout << "[ERR] Failed to write an object to its memfd" << std::endl;
+				return false;
+			}
+			written += n;
+		}
+		paths.push_back("/proc/self/fd/" + std::to_string(fd));
+	}
+
+	// What `cc` passes for a PIE, with libgcc for the helpers the backend may call
+	std::vector<std::string> args = {
+		"ld.lld", "-pie", "--eh-frame-hdr", "-z", "relro", "--hash-style=gnu", "--build-id",
+		"-dynamic-linker", loader, "-o", output,
+		_1337_CRT_DIR "/Scrt1.o", _1337_CRT_DIR "/crti.o", _1337_GCC_DIR "/crtbeginS.o",
+		"-L" _1337_GCC_DIR, "-L" _1337_CRT_DIR,
+	};
+	args.insert(args.end(), paths.begin(), paths.end());
+	args.insert(args.end(), {
+		_1337_RUNTIME_LIB, "-lpthread",
+		"-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state",
+		"-lc",
+		"-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state",
+		_1337_GCC_DIR "/crtendS.o", _1337_CRT_DIR "/crtn.o",
+	});
+	std::vector<const char *> argv;
+	for (auto &arg : args)
+		argv.push_back(arg.c_str());
+
+	// After a crash LLD's state is gone, a server can't link anymore
+	static std::mutex lld;
+	static bool broken = false;
+	std::lock_guard<std::mutex> lock(lld);
+	if (broken) {
+		std::cout << "[ERR] LLD can't link again in this process, restart the server" << std::endl;
+		return false;
+	}
+	std::string messages;
+	llvm::raw_string_ostream out(messages);
+	auto result = lld::lldMain(argv, out, console_errors(), { { lld::Gnu, &lld::elf::link } });
+	std::cout << messages;
+	if (!result.canRunAgain) {
+		broken = true;
+		std::cout << "[ERR] LLD can't link again in this process" << std::endl;
+		return false;
+	}
+	if (result.retCode != 0)
+		return false;
+
+	std::cout << "Successfully created executable '" << output << "'" << std::endl;
+	return true;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef _LINKER_HPP_
+#define _LINKER_HPP_
+
+#include "llvm.hpp"
+#include "codegen.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * `-o prog`: the objects are linked into an executable by LLD's ELF driver, in the compiler's
+ * process, instead of writing `output.o` and running `cc` on it. The objects never touch the
+ * disk, each one goes to LLD as a memfd, by its /proc/self/fd path.
+ *
+ * The program is linked like `cc` links it, as a PIE against the C library and the runtime
+ * library (arenas, `-finstrument`). The startup files and the library paths are those of the
+ * C compiler the build found, the dynamic loader is the one the compiler itself runs on.
+ *
+ * Linux and the host only. LLD keeps global state, so one link runs at a time.
+ */
+class Linker {
+private:
+	CodegenOptions options;
+public:
+	inline Linker(CodegenOptions options)
+		: options(options)
+	{}
+
+	bool link(const std::vector<llvm::SmallVector<char, 0>> &objects, const std::string &output);
+};
+
+#endif
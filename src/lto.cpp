@@ -0,0 +1,94 @@
+#include "lto.hpp"
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <filesystem>
+
+bool LinkTimeOptimizer::link(const std::vector<std::string> &inputs, const std::string &output, const std::filesystem::path &directory)
+{
+	llvm::lto::Config config;
+	config.CPU = "generic";
+	config.RelocModel = llvm::Reloc::PIC_;
+	config.DefaultTriple = target_triple(this->options);
+	initialize_target(config.DefaultTriple);
+	config.OptLevel = this->options.opt_level;
+
+	auto threads = llvm::heavyweight_hardware_concurrency(this->jobs);
+	llvm::lto::LTO lto(std::move(config), llvm::lto::createInProcessThinBackend(threads));
+
+	// The buffers have to outlive the link, the modules are only read lazily
+	std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+	std::map<unsigned int, std::string> objects = { { 0, output } };
+	std::set<std::string> defined;
+	for (auto &input : inputs) {
+		auto buffer = llvm::MemoryBuffer::getFile(input);
+		if (!buffer) {
+			std::cout << "[ERR] Failed to read '" << input << "'" << std::endl;
+			return false;
+		}
+		buffers.push_back(std::move(*buffer));
+
+		auto file = llvm::lto::InputFile::create(buffers.back()->getMemBufferRef());
+		if (!file)
+			return this->fail(file.takeError());
+
+		// The first definition wins, like a linker would pick it. Only weak ones may repeat.
+		std::vector<llvm::lto::SymbolResolution> resolutions;
+		for (auto &symbol : (*file)->symbols()) {
+			llvm::lto::SymbolResolution resolution;
+			bool first = !symbol.isUndefined() && defined.insert(symbol.getName().str()).second;
+			if (!symbol.isUndefined() && !first && !symbol.isWeak()) {
+				std::cout << "[ERR] '" << symbol.getName().str() << "' is defined more than once" << std::endl;
+				return false;
+			}
+
+			resolution.Prevailing = first;
+			resolution.FinalDefinitionInLinkageUnit = !symbol.isUndefined();
+			resolution.VisibleToRegularObj = !symbol.canBeOmittedFromSymbolTable();
+			resolutions.push_back(resolution);
+		}
+
+		// The merged module is task 0, the ThinLTO files follow in the order they're added
+		auto info = (*file)->getSingleBitcodeModule().getLTOInfo();
+		if (!info)
+			return this->fail(info.takeError());
+		if (info->IsThinLTO)
+			objects[lto.getMaxTasks()] = (directory / std::filesystem::path(input).stem()).concat(".o").lexically_normal().string();
+
+		if (auto error = lto.add(std::move(*file), resolutions))
+			return this->fail(std::move(error));
+	}
+
+	// Called by the backend threads, `objects` isn't changed anymore
+	std::mutex lock;
+	std::set<unsigned int> written;
+	auto add_stream = [&](unsigned int task, const llvm::Twine &) -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+		auto object = objects.find(task);
+		if (object == objects.end())
+			return llvm::createStringError(llvm::inconvertibleErrorCode(), "no object for LTO task " + std::to_string(task));
+
+		std::error_code errcode;
+		auto stream = std::make_unique<llvm::raw_fd_ostream>(object->second, errcode, llvm::sys::fs::OF_None);
+		if (errcode)
+			return llvm::errorCodeToError(errcode);
+
+		std::lock_guard<std::mutex> guard(lock);
+		written.insert(task);
+		return std::make_unique<llvm::CachedFileStream>(std::move(stream), object->second);
+	};
+	if (auto error = lto.run(add_stream))
+		return this->fail(std::move(error));
+
+	for (auto task : written)
+		std::cout << "Successfully created object file '" << objects[task] << "'" << std::endl;
+
+	return true;
+}
+
+bool LinkTimeOptimizer::fail(llvm::Error error)
+{
+	std::cout << "[ERR] " << llvm::toString(std::move(error)) << std::endl;
+	return false;
+}
@@ -0,0 +1,41 @@
+#ifndef _LTO_HPP_
+#define _LTO_HPP_
+
+#include "llvm.hpp"
+#include "codegen.hpp"
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/*
+ * The link step of `-flto`: the bitcode of separately compiled files is optimized as a
+ * whole, so calls from one file into another can be inlined.
+ *
+ * Whether a file takes part in full or thin LTO depends on how it was compiled. Full LTO
+ * merges the files into one module, which is optimized and emitted as a single object
+ * (`-o`, `output.o` by default). ThinLTO files carry a summary of what they define and
+ * call. Each one is optimized on its own, on `-j N` threads, after importing the functions
+ * of other files it calls. Every ThinLTO file gets its own object in `directory`, named
+ * after the file.
+ *
+ * The link optimizes at the `-O` level it's given, or at `-O2` without one, since the
+ * link is the point of `-flto`.
+ *
+ * Nothing but the bitcode is known about the final program, so every symbol that isn't
+ * internal stays visible to the code it's linked with.
+ */
+class LinkTimeOptimizer {
+private:
+	CodegenOptions options;
+	size_t jobs;
+public:
+	inline LinkTimeOptimizer(CodegenOptions options, size_t jobs)
+		: options(options), jobs(jobs)
+	{}
+
+	bool link(const std::vector<std::string> &inputs, const std::string &output, const std::filesystem::path &directory);
+private:
+	bool fail(llvm::Error error);
+};
+
+#endif
@@ -1,66 +1,33 @@
-#include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
-#include "parser.hpp"
-#include "codegen.hpp"
+#include <thread>
+#include <iostream>
+#include <algorithm>
+#include "llvm.hpp"
+#include "driver.hpp"
+#include "server.hpp"
 
 int main(int argc, char **argv)
 {
-	if (argc < 2) {
-		std::cout << "usage: 1337 [SOURCE]" << std::endl;
-		return 1;
-	}
-
-	/*
-	auto lexer = Lexer(content);
-	std::unique_ptr<Token> token;
-	while (true) {
-		token = lexer.tokenize();
-		if (!token) {
-			std::cout << "Failed to tokenize" << std::endl;
-			return -1;
-		}
-
-		std::cout << "TOKEN: " << static_cast<int>(token->type) << ", " << token->value << std::endl;
-
-		if (token->type == TokenType::Eof) {
-			std::cout << "File ended" << std::endl;
-			break;
-		}
-	}
-	*/
-
-	/*
-	auto parser = Parser(argv[1]);
-
-	while (true) {
-		auto expr = parser.parse_expression();
-		if (!expr)
-			break;
-
-		std::cout << "EXPR: " << expr->to_string() << std::endl;
-	}
-
-	if (!parser.is_finished()) {
-		std::cout << "Failed to parse until EOF" << std::endl;
-	}
-	*/
-
-	auto parser = Parser(argv[1]);
-	auto codegen = Codegen();
-	while (true) {
-		auto expr = parser.parse_expression();
-		if (!expr)
-			break;
-
-		if (!codegen.include(expr.get())) {
-			std::cout << "[ERR] Failed to codegen the following expression: "
-				<< expr->to_string();
+	// 1337 --server [--socket=PATH] [-j N]
+	if (argc > 1 && std::string(argv[1]) == "--server") {
+		auto socket = Server::default_socket();
+		size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+		for (int i = 2; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg.rfind("--socket=", 0) == 0) {
+				socket = arg.substr(9);
+			} else if (arg == "-j" && i + 1 < argc && !llvm::StringRef(argv[i + 1]).getAsInteger(10, threads)) {
+				threads = std::max<size_t>(threads, 1);
+				++i;
+			} else {
+				std::cout << "usage: 1337 --server [--socket=PATH] [-j N]" << std::endl;
+				return 1;
+			}
 		}
+		return Server(socket, threads).run();
 	}
-	codegen.dump();
-	codegen.write_object("output.o");
 
-	return 0;
+	Invocation invocation;
+	invocation.args.assign(argv + 1, argv + argc);
+	return run_compiler(invocation);
 }
@@ -2,6 +2,7 @@
 #include "ast.hpp"
 #include <memory>
 #include <vector>
+#include <utility>
 
 // Token Patterns: [Colon] [Ident] [Equals] <Expr>
 //                 [Colon] [Equals] <Expr>
@@ -20,6 +21,8 @@ Parser::parse_declaration(SourceLocation loc, std::string ident)
 	switch (this->token->type) {
 	case TokenType::Identifier:
 	case TokenType::Fn:
+	case TokenType::Multiply:
+	case TokenType::LeftBracket:
 		explicit_type = this->parse_type();
 		if (!explicit_type)
 			return decl_ast;
@@ -65,9 +68,30 @@ Parser::parse_type()
 	case TokenType::Identifier:
 	{
 		auto basic_type = BasicTypeExprAst { loc, this->token->value };
-		this->advance();
+		if (!this->advance())
+			return nullptr;
+
+		if (this->token->type == TokenType::Less) {
+			std::vector<std::unique_ptr<TypeExprAst>> args;
+			if (!this->parse_type_args(args))
+				return nullptr;
+
+			return std::make_unique<TypeExprAst>(loc, std::make_unique<GenericTypeExprAst>(loc, basic_type.type, std::move(args)));
+		}
+
 		return std::make_unique<TypeExprAst>(loc, std::make_unique<BasicTypeExprAst>(basic_type));
 	}
+	case TokenType::Multiply:
+	{
+		if (!this->advance())
+			return nullptr;
+
+		auto pointee = this->parse_type();
+		if (!pointee)
+			return nullptr;
+
+		return std::make_unique<TypeExprAst>(loc, std::make_unique<PointerTypeExprAst>(loc, std::move(pointee)));
+	}
 	case TokenType::LeftBracket:
 	{
 		this->advance();
@@ -90,8 +114,35 @@ Parser::parse_type()
 	return nullptr;
 }
 
+// Token Patterns: [Less] <Type> ([Comma] <Type>)* [Greater]
+bool
+Parser::parse_type_args(std::vector<std::unique_ptr<TypeExprAst>> &type_args)
+{
+	if (!this->advance())
+		return false;
+
+	while (this->token->type != TokenType::Greater) {
+		auto type = this->parse_type();
+		if (!type || !this->token)
+			return false;
+
+		type_args.push_back(std::move(type));
+
+		if (this->token->type == TokenType::Comma) {
+			if (!this->advance())
+				return false;
+		} else if (this->token->type != TokenType::Greater) {
+			return false;
+		}
+	}
+
+	this->advance(); // Skip over '>'
+
+	return true;
+}
+
 std::unique_ptr<CallExprAst>
-Parser::parse_call(SourceLocation loc, std::string ident)
+Parser::parse_call(SourceLocation loc, std::string ident, std::vector<std::unique_ptr<TypeExprAst>> type_args)
 {
 	std::vector<std::unique_ptr<ExprAst>> args;
 
@@ -117,7 +168,7 @@ Parser::parse_call(SourceLocation loc, std::string ident)
 
 	this->advance(); // Skip over right parenthesis
 
-	return std::make_unique<CallExprAst>(loc, ident, std::move(args));
+	return std::make_unique<CallExprAst>(loc, ident, std::move(type_args), std::move(args));
 }
 
 std::unique_ptr<ArrayIndexExprAst>
@@ -143,6 +194,7 @@ Parser::parse_identifier()
 {
 	std::string ident = this->token->value;
 	SourceLocation loc = this->token->loc;
+	std::unique_ptr<ExprAst> expr = nullptr;
 
 	if (!this->advance())
 		return nullptr;
@@ -151,29 +203,198 @@ Parser::parse_identifier()
 	case TokenType::Colon:
 		return this->parse_declaration(loc, ident);
 	case TokenType::LeftParen:
-		return this->parse_call(loc, ident);
+		expr = this->parse_call(loc, ident);
+		if (!expr)
+			return nullptr;
+		break;
 	case TokenType::LeftBracket:
-		return this->parse_array_index(loc, ident);
+		expr = this->parse_array_index(loc, ident);
+		if (!expr)
+			return nullptr;
+		break;
+	case TokenType::Less:
+	{
+		// Explicit type arguments, e.g. `alloc<i32>()`. Otherwise this is a comparison,
+		// so rewind and let the binary operator parsing handle it
+		auto state = this->lexer.save();
+		auto less = *this->token;
+		std::vector<std::unique_ptr<TypeExprAst>> type_args;
+		if (this->parse_type_args(type_args) && this->token && this->token->type == TokenType::LeftParen) {
+			expr = this->parse_call(loc, ident, std::move(type_args));
+			if (!expr)
+				return nullptr;
+			break;
+		}
+
+		this->lexer.restore(state);
+		this->token = std::make_unique<Token>(less);
+		break;
+	}
 	default:
 		break;
 	}
 
-	return std::make_unique<VariableExprAst>(loc, ident);
+	if (!expr)
+		expr = std::make_unique<VariableExprAst>(loc, ident);
+
+	expr = this->parse_members(std::move(expr));
+	if (!expr || !this->token)
+		return expr;
+
+	// Token Patterns: (<Identifier> | <Member>) [Equals] <Expr>
+	if (this->token->type == TokenType::Equals &&
+	    (dynamic_cast<VariableExprAst *>(expr.get()) || dynamic_cast<MemberExprAst *>(expr.get()))) {
+		if (!this->advance())
+			return nullptr;
+
+		auto value = this->parse_expression();
+		if (!value)
+			return nullptr;
+
+		return std::make_unique<AssignExprAst>(loc, std::move(expr), std::move(value));
+	}
+
+	return expr;
+}
+
+// Token Patterns: <Expr> ([Dot] [Identifier])*
+std::unique_ptr<ExprAst>
+Parser::parse_members(std::unique_ptr<ExprAst> object)
+{
+	while (this->token && this->token->type == TokenType::Dot) {
+		auto loc = this->token->loc;
+		if (!this->advance() || this->token->type != TokenType::Identifier)
+			return nullptr;
+
+		object = std::make_unique<MemberExprAst>(loc, std::move(object), this->token->value);
+		this->advance();
+	}
+
+	return object;
+}
+
+// Token Patterns: [At] [Identifier] ([LeftParen] [Integer] [RightParen])?
+bool
+Parser::parse_attribute(std::string &name, unsigned int &arg)
+{
+	if (!this->advance() || this->token->type != TokenType::Identifier)
+		return false;
+
+	name = this->token->value;
+	if (!this->advance())
+		return false;
+
+	if (this->token->type == TokenType::LeftParen) {
+		// A number that doesn't fit is as wrong as no number
+		if (!this->advance() || this->token->type != TokenType::Integer ||
+		    llvm::StringRef(this->token->value).getAsInteger(10, arg))
+			return false;
+		if (!this->advance() || this->token->type != TokenType::RightParen)
+			return false;
+		this->advance();
+	}
+
+	return this->token != nullptr;
+}
+
+// Token Patterns: [Struct] ([At] [Identifier])* [LeftCurly] (<Field> [Comma]?)* [RightCurly]
+// Token Patterns (Field): ([At] [Identifier] ([LeftParen] [Integer] [RightParen])?)* [Identifier] [Colon] <Type>
+// Example: struct @packed { tag: u8, @align(64) hits: i64, @cold name: str }
+std::unique_ptr<StructTypeExprAst>
+Parser::parse_struct()
+{
+	auto loc = this->token->loc;
+	bool packed = false;
+	std::vector<std::unique_ptr<StructFieldAst>> fields;
+
+	if (!this->advance())
+		return nullptr;
+
+	while (this->token->type == TokenType::At) {
+		std::string name;
+		unsigned int arg = 0;
+		if (!this->parse_attribute(name, arg) || name != "packed")
+			return nullptr;
+		packed = true;
+	}
+
+	if (this->token->type != TokenType::LeftCurly || !this->advance())
+		return nullptr;
+
+	while (this->token->type != TokenType::RightCurly) {
+		unsigned int align = 0;
+		bool cold = false;
+		while (this->token->type == TokenType::At) {
+			std::string name;
+			unsigned int arg = 0;
+			if (!this->parse_attribute(name, arg))
+				return nullptr;
+
+			if (name == "align" && llvm::isPowerOf2_32(arg))
+				align = arg;
+			else if (name == "cold")
+				cold = true;
+			else
+				return nullptr;
+		}
+
+		if (this->token->type != TokenType::Identifier)
+			return nullptr;
+		auto field_loc = this->token->loc;
+		auto name = this->token->value;
+		if (!this->advance() || this->token->type != TokenType::Colon || !this->advance())
+			return nullptr;
+
+		auto type = this->parse_type();
+		if (!type || !this->token)
+			return nullptr;
+
+		auto field = std::make_unique<StructFieldAst>(field_loc, name, std::move(type));
+		field->align = align;
+		field->cold = cold;
+		fields.push_back(std::move(field));
+
+		if (this->token->type == TokenType::Comma && !this->advance())
+			return nullptr;
+	}
+
+	this->advance();
+
+	auto expr = std::make_unique<StructTypeExprAst>(loc, std::move(fields));
+	expr->packed = packed;
+	return expr;
 }
 
-// Token Patterns: [Fn] [Identifier] [LeftParen] ([Identifier] [Colon] [Type] [Comma])* [RightParen]
-// Token Patterns: [Fn] [LeftParen] ([Identifier] [Colon] [Type] [Comma])* [RightParen]
+// Token Patterns: [Fn] <TypeParams>? [Identifier] [LeftParen] ([Mut]? [Identifier] [Colon] [Type] [Comma])* [RightParen]
+// Token Patterns: [Fn] <TypeParams>? [LeftParen] ([Mut]? [Identifier] [Colon] [Type] [Comma])* [RightParen]
+// Token Patterns (TypeParams): [Less] [Identifier] ([Comma] [Identifier])* [Greater]
 // Example: fn i32 (x: i32, y: i32)
+//          fn <T> T (x: T, y: T)
 std::unique_ptr<FunctionProtoExprAst>
 Parser::parse_function_proto()
 {
 	std::vector<std::unique_ptr<FunctionParamAst>> params = {};
 	std::unique_ptr<TypeExprAst> return_type = nullptr;
+	std::vector<std::string> type_params = {};
 	auto loc = this->token->loc;
 
 	if (!this->advance())
 		return nullptr;
 
+	// Type parameters of a generic function
+	if (this->token->type == TokenType::Less) {
+		do {
+			if (!this->advance() || this->token->type != TokenType::Identifier)
+				return nullptr;
+			type_params.push_back(this->token->value);
+			if (!this->advance())
+				return nullptr;
+		} while (this->token->type == TokenType::Comma);
+
+		if (this->token->type != TokenType::Greater || !this->advance())
+			return nullptr;
+	}
+
 	// Parse return type if it exists
 	if (this->token->type != TokenType::LeftParen) {
 		return_type = this->parse_type();
@@ -188,6 +409,10 @@ Parser::parse_function_proto()
 		return nullptr;
 
 	while (this->token->type != TokenType::RightParen) {
+		bool mut = this->token->type == TokenType::Mut;
+		if (mut && !this->advance())
+			return nullptr;
+
 		if (this->token->type != TokenType::Identifier)
 			return nullptr;
 
@@ -195,6 +420,7 @@ Parser::parse_function_proto()
 		if (!param)
 			return nullptr;
 
+		param->mut = mut;
 		params.push_back(std::move(param));
 
 		if (!this->token)
@@ -208,7 +434,7 @@ Parser::parse_function_proto()
 
 	this->advance();
 
-	return std::make_unique<FunctionProtoExprAst>(loc, std::move(params), std::move(return_type));
+	return std::make_unique<FunctionProtoExprAst>(loc, std::move(params), std::move(return_type), type_params);
 }
 
 // Token Patterns: [Ident] [Colon] [Type]
@@ -252,6 +478,39 @@ Parser::parse_codeblock()
 	return std::make_unique<CodeblockExprAst>(loc, std::move(subexprs));
 }
 
+// Token Patterns: [If] <Expr> <Codeblock> ([Else] (<Codeblock> | <If>))?
+std::unique_ptr<IfExprAst>
+Parser::parse_if()
+{
+	auto loc = this->token->loc;
+	if (!this->advance())
+		return nullptr;
+
+	auto condition = this->parse_expression();
+	if (!condition || !this->token || this->token->type != TokenType::LeftCurly)
+		return nullptr;
+
+	auto then_body = this->parse_codeblock();
+	if (!then_body || !this->token)
+		return nullptr;
+
+	std::unique_ptr<ExprAst> else_body = nullptr;
+	if (this->token->type == TokenType::Else) {
+		if (!this->advance())
+			return nullptr;
+
+		if (this->token->type == TokenType::If)
+			else_body = this->parse_if();
+		else if (this->token->type == TokenType::LeftCurly)
+			else_body = this->parse_codeblock();
+
+		if (!else_body)
+			return nullptr;
+	}
+
+	return std::make_unique<IfExprAst>(loc, std::move(condition), std::move(then_body), std::move(else_body));
+}
+
 std::unique_ptr<ExprAst>
 Parser::parse_binop_rhs(int expr_prec, std::unique_ptr<ExprAst> lhs)
 {
@@ -389,7 +648,10 @@ Parser::parse_primary()
 		if (!this->token || this->token->type != TokenType::LeftCurly)
 			return proto;
 
+		// A function written in a `defer` has its own scopes to leave
+		auto deferring = std::exchange(this->deferring, false);
 		auto body = this->parse_codeblock();
+		this->deferring = deferring;
 		if (!body)
 			return nullptr;
 
@@ -398,7 +660,13 @@ Parser::parse_primary()
 	}
 	case TokenType::Extern:
 	{
-		if (!this->advance() || this->token->type != TokenType::Identifier)
+		// Token Patterns: [Extern] [Mut]? [Identifier] <Declaration>
+		if (!this->advance())
+			return nullptr;
+		bool mut = this->token->type == TokenType::Mut;
+		if (mut && !this->advance())
+			return nullptr;
+		if (this->token->type != TokenType::Identifier)
 			return nullptr;
 		auto ident = *this->token;
 		if (!this->advance() || this->token->type != TokenType::Colon)
@@ -407,9 +675,136 @@ Parser::parse_primary()
 		auto decl_expr = this->parse_declaration(ident.loc, ident.value);
 		if (!decl_expr)
 			return nullptr;
+
+		// Defined by another file or library, so it has to be visible outside of this one
+		decl_expr->exported = true;
+		decl_expr->mut = mut;
 		expr = std::make_unique<ExternExprAst>(ident.loc, std::move(decl_expr));
 		break;
 	}
+	case TokenType::Pub:
+	case TokenType::Mut:
+	{
+		// Token Patterns: [Pub]? [Mut]? [Identifier] <Declaration>
+		bool exported = this->token->type == TokenType::Pub;
+		bool mut = !exported;
+		if (!this->advance())
+			return nullptr;
+		if (exported && this->token->type == TokenType::Mut) {
+			mut = true;
+			if (!this->advance())
+				return nullptr;
+		}
+
+		if (this->token->type != TokenType::Identifier)
+			return nullptr;
+		auto ident = *this->token;
+		if (!this->advance() || this->token->type != TokenType::Colon)
+			return nullptr;
+
+		auto decl_expr = this->parse_declaration(ident.loc, ident.value);
+		if (!decl_expr)
+			return nullptr;
+		decl_expr->exported = exported;
+		decl_expr->mut = mut;
+		expr = std::move(decl_expr);
+		break;
+	}
+	case TokenType::Arena:
+	{
+		// Token Patterns: [Arena] [Identifier] <Codeblock>
+		auto loc = this->token->loc;
+		if (!this->advance() || this->token->type != TokenType::Identifier)
+			return nullptr;
+		auto name = std::make_unique<VariableExprAst>(this->token->loc, this->token->value);
+		if (!this->advance() || this->token->type != TokenType::LeftCurly)
+			return nullptr;
+
+		auto body = this->parse_codeblock();
+		if (!body)
+			return nullptr;
+		expr = std::make_unique<ArenaExprAst>(loc, std::move(name), std::move(body));
+		break;
+	}
+	case TokenType::Defer:
+	{
+		// Token Patterns: [Defer] <Expr>
+		// The cleanups run at every exit of the scope, a deferred `return` or `become` would be
+		// one of those exits and run them again
+		auto loc = this->token->loc;
+		if (this->deferring || !this->advance())
+			return nullptr;
+
+		this->deferring = true;
+		auto deferred = this->parse_expression();
+		this->deferring = false;
+		if (!deferred)
+			return nullptr;
+		expr = std::make_unique<DeferExprAst>(loc, std::move(deferred));
+		break;
+	}
+	case TokenType::Comptime:
+	{
+		// Token Patterns: [Comptime] <Expr>
+		auto loc = this->token->loc;
+		if (!this->advance())
+			return nullptr;
+
+		auto evaluated = this->parse_expression();
+		if (!evaluated)
+			return nullptr;
+		expr = std::make_unique<ComptimeExprAst>(loc, std::move(evaluated));
+		break;
+	}
+	case TokenType::Return:
+	{
+		// Token Patterns: [Return] <Expr>?
+		// The value has to start on the same line, there are no statement terminators
+		auto loc = this->token->loc;
+		if (this->deferring || !this->advance())
+			return nullptr;
+
+		std::unique_ptr<ExprAst> value = nullptr;
+		if (this->token->loc.line == loc.line && this->token->type != TokenType::RightCurly &&
+		    this->token->type != TokenType::Eof) {
+			value = this->parse_expression();
+			if (!value)
+				return nullptr;
+		}
+		expr = std::make_unique<ReturnExprAst>(loc, std::move(value));
+		break;
+	}
+	case TokenType::Become:
+	{
+		// Token Patterns: [Become] <Call>
+		auto loc = this->token->loc;
+		if (this->deferring || !this->advance())
+			return nullptr;
+
+		auto call = this->parse_primary();
+		if (!call || !dynamic_cast<CallExprAst *>(call.get()))
+			return nullptr;
+		expr = std::make_unique<BecomeExprAst>(loc, std::unique_ptr<CallExprAst>(static_cast<CallExprAst *>(call.release())));
+		break;
+	}
+	case TokenType::If:
+		expr = this->parse_if();
+		break;
+	case TokenType::Struct:
+		expr = this->parse_struct();
+		break;
+	case TokenType::LeftParen:
+	{
+		// Token Patterns: [LeftParen] <Expr> [RightParen]
+		if (!this->advance())
+			return nullptr;
+
+		expr = this->parse_expression();
+		if (!expr || !this->token || this->token->type != TokenType::RightParen)
+			return nullptr;
+		this->advance();
+		break;
+	}
 	case TokenType::LeftCurly:
 		expr = this->parse_codeblock();
 		break;
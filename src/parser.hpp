@@ -3,17 +3,20 @@
 
 #include "lexer.hpp"
 #include "ast.hpp"
+#include "timing.hpp"
 
 class Parser {
 private:
 	Lexer lexer;
 	std::unique_ptr<Token> token = nullptr;
+	PhaseSample *lexing = nullptr; // For `-ftime-report`, the time spent in the lexer is added up here
+	bool deferring = false; // In a `defer`, which can neither leave the scope it runs at nor defer again
 public:
 	inline Parser(std::string content, std::string filepath) noexcept: lexer(content, filepath) {
 		this->advance();
 	}
 
-	inline Parser(std::string filepath): lexer(filepath) {
+	inline Parser(std::string filepath, PhaseSample *lexing = nullptr): lexer(filepath), lexing(lexing) {
 		this->advance();
 	}
 public:
@@ -26,7 +29,14 @@ public:
 	inline std::unique_ptr<Token> &
 	advance()
 	{
+		if (!this->lexing) {
+			this->token = this->lexer.tokenize();
+			return this->token;
+		}
+
+		auto start = PhaseSample::now_wall();
 		this->token = this->lexer.tokenize();
+		*this->lexing += PhaseSample::now_wall() - start;
 		return this->token;
 	}
 
@@ -49,14 +59,27 @@ private:
 	parse_declaration(SourceLocation loc, std::string ident);
 
 	std::unique_ptr<CallExprAst>
-	parse_call(SourceLocation loc, std::string ident);
+	parse_call(SourceLocation loc, std::string ident,
+	           std::vector<std::unique_ptr<TypeExprAst>> type_args = {});
 
 	std::unique_ptr<ArrayIndexExprAst>
 	parse_array_index(SourceLocation loc, std::string ident);
 
+	std::unique_ptr<ExprAst>
+	parse_members(std::unique_ptr<ExprAst> object);
+
+	bool
+	parse_attribute(std::string &name, unsigned int &arg);
+
+	std::unique_ptr<StructTypeExprAst>
+	parse_struct();
+
 	std::unique_ptr<TypeExprAst>
 	parse_type();
 
+	bool
+	parse_type_args(std::vector<std::unique_ptr<TypeExprAst>> &type_args);
+
 	std::unique_ptr<FunctionProtoExprAst>
 	parse_function_proto();
 
@@ -66,6 +89,9 @@ private:
 	std::unique_ptr<CodeblockExprAst>
 	parse_codeblock();
 
+	std::unique_ptr<IfExprAst>
+	parse_if();
+
 	std::unique_ptr<ExprAst>
 	parse_binop_rhs(int expr_prec, std::unique_ptr<ExprAst> lhs);
 };
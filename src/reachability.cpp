@@ -0,0 +1,122 @@
+#include "reachability.hpp"
+
+// Top level expressions have to be indexed in order, `is_reached` is only valid after the last one
+void Reachability::index(ExprAst *expr)
+{
+	auto decl = dynamic_cast<DeclarationExprAst *>(expr);
+	if (!decl) {
+		this->roots.push_back(expr);
+		return;
+	}
+
+	this->declarations[decl->name->name] = decl;
+	if (decl->exported || decl->name->name == "main")
+		this->roots.push_back(decl);
+}
+
+bool Reachability::is_reached(ExprAst *expr)
+{
+	if (!this->roots.empty())
+		this->walk();
+
+	return this->reached.count(expr) > 0;
+}
+
+void Reachability::walk()
+{
+	for (auto root : this->roots) {
+		if (this->reached.insert(root).second)
+			this->worklist.push_back(root);
+	}
+	this->roots.clear();
+
+	while (!this->worklist.empty()) {
+		auto expr = this->worklist.back();
+		this->worklist.pop_back();
+
+		// The name of a declaration doesn't use anything
+		if (auto decl = dynamic_cast<DeclarationExprAst *>(expr); decl != nullptr) {
+			this->visit(decl->explicit_type.get());
+			this->visit(decl->value.get());
+		} else {
+			this->visit(expr);
+		}
+	}
+}
+
+void Reachability::reach(const std::string &name)
+{
+	auto it = this->declarations.find(name);
+	if (it != this->declarations.end() && this->reached.insert(it->second).second)
+		this->worklist.push_back(it->second);
+}
+
+void Reachability::visit(ExprAst *expr)
+{
+	if (!expr)
+		return;
+
+	if (auto var = dynamic_cast<VariableExprAst *>(expr); var != nullptr) {
+		this->reach(var->name);
+	} else if (auto call = dynamic_cast<CallExprAst *>(expr); call != nullptr) {
+		this->reach(call->function);
+		for (auto &type : call->type_args)
+			this->visit(type.get());
+		for (auto &arg : call->args)
+			this->visit(arg.get());
+	} else if (auto type = dynamic_cast<TypeExprAst *>(expr); type != nullptr) {
+		this->visit(type->type.get());
+	} else if (auto basic = dynamic_cast<BasicTypeExprAst *>(expr); basic != nullptr) {
+		this->reach(basic->type);
+	} else if (auto arr = dynamic_cast<ArrayTypeExprAst *>(expr); arr != nullptr) {
+		this->visit(arr->recursing_type.get());
+	} else if (auto pointer = dynamic_cast<PointerTypeExprAst *>(expr); pointer != nullptr) {
+		this->visit(pointer->pointee.get());
+	} else if (auto generic = dynamic_cast<GenericTypeExprAst *>(expr); generic != nullptr) {
+		for (auto &arg : generic->args)
+			this->visit(arg.get());
+	} else if (auto structure = dynamic_cast<StructTypeExprAst *>(expr); structure != nullptr) {
+		for (auto &field : structure->fields)
+			this->visit(field->type.get());
+	} else if (auto proto = dynamic_cast<FunctionProtoExprAst *>(expr); proto != nullptr) {
+		for (auto &param : proto->params)
+			this->visit(param->type.get());
+		this->visit(proto->return_type.get());
+	} else if (auto func = dynamic_cast<FunctionExprAst *>(expr); func != nullptr) {
+		this->visit(func->proto.get());
+		this->visit(func->body.get());
+	} else if (auto block = dynamic_cast<CodeblockExprAst *>(expr); block != nullptr) {
+		for (auto &subexpr : block->subexprs)
+			this->visit(subexpr.get());
+	} else if (auto decl = dynamic_cast<DeclarationExprAst *>(expr); decl != nullptr) {
+		this->visit(decl->explicit_type.get());
+		this->visit(decl->value.get());
+	} else if (auto assign = dynamic_cast<AssignExprAst *>(expr); assign != nullptr) {
+		this->visit(assign->target.get());
+		this->visit(assign->value.get());
+	} else if (auto member = dynamic_cast<MemberExprAst *>(expr); member != nullptr) {
+		this->visit(member->object.get());
+	} else if (auto binop = dynamic_cast<BinaryOpExprAst *>(expr); binop != nullptr) {
+		this->visit(binop->left.get());
+		this->visit(binop->right.get());
+	} else if (auto index = dynamic_cast<ArrayIndexExprAst *>(expr); index != nullptr) {
+		this->visit(index->var.get());
+		this->visit(index->index.get());
+	} else if (auto if_expr = dynamic_cast<IfExprAst *>(expr); if_expr != nullptr) {
+		this->visit(if_expr->condition.get());
+		this->visit(if_expr->then_body.get());
+		this->visit(if_expr->else_body.get());
+	} else if (auto ret = dynamic_cast<ReturnExprAst *>(expr); ret != nullptr) {
+		this->visit(ret->value.get());
+	} else if (auto become = dynamic_cast<BecomeExprAst *>(expr); become != nullptr) {
+		this->visit(become->call.get());
+	} else if (auto arena = dynamic_cast<ArenaExprAst *>(expr); arena != nullptr) {
+		this->visit(arena->body.get());
+	} else if (auto defer = dynamic_cast<DeferExprAst *>(expr); defer != nullptr) {
+		this->visit(defer->expr.get());
+	} else if (auto comptime = dynamic_cast<ComptimeExprAst *>(expr); comptime != nullptr) {
+		this->visit(comptime->expr.get());
+	} else if (auto ext = dynamic_cast<ExternExprAst *>(expr); ext != nullptr) {
+		this->visit(ext->decl.get());
+	}
+}
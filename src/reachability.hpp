@@ -0,0 +1,35 @@
+#ifndef _REACHABILITY_HPP_
+#define _REACHABILITY_HPP_
+
+#include "ast.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+ * Finds the top level declarations a program uses, so `-flazy` only generates those.
+ *
+ * Declarations are indexed by name. Starting from `main` and the `pub` declarations, every
+ * name a reached declaration mentions (a call, a variable, a type) reaches the declaration
+ * of that name in turn. Anything else is never looked at by codegen.
+ *
+ * It only looks at names and may reach too much, e.g. a local shadowing a global still
+ * reaches the global. That costs some code, never correctness.
+ */
+class Reachability {
+private:
+	std::map<std::string, DeclarationExprAst *> declarations;
+	std::vector<ExprAst *> roots;
+	std::set<ExprAst *> reached;
+	std::vector<ExprAst *> worklist;
+public:
+	void index(ExprAst *expr);
+	bool is_reached(ExprAst *expr);
+private:
+	void walk();
+	void reach(const std::string &name);
+	void visit(ExprAst *expr);
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "refcount.hpp"
+#include <vector>
+
+const char *RcRuntime::name(RcKind kind, RcOp op)
+{
+	switch (op) {
+	case RcOp::Alloc:
+		return kind == RcKind::Arc ? "__1337_arc_alloc" : "__1337_rc_alloc";
+	case RcOp::Retain:
+		return kind == RcKind::Arc ? "__1337_arc_retain" : "__1337_rc_retain";
+	case RcOp::Release:
+		return kind == RcKind::Arc ? "__1337_arc_release" : "__1337_rc_release";
+	default:
+		break;
+	}
+
+	return nullptr;
+}
+
+std::pair<RcKind, RcOp> RcRuntime::classify(llvm::Value *value)
+{
+	auto call = llvm::dyn_cast<llvm::CallBase>(value);
+	if (!call || !call->getCalledFunction())
+		return { RcKind::None, RcOp::None };
+
+	auto name = call->getCalledFunction()->getName();
+	for (auto kind : { RcKind::Rc, RcKind::Arc }) {
+		for (auto op : { RcOp::Alloc, RcOp::Retain, RcOp::Release }) {
+			if (name == RcRuntime::name(kind, op))
+				return { kind, op };
+		}
+	}
+
+	return { RcKind::None, RcOp::None };
+}
+
+llvm::PreservedAnalyses RefcountOptPass::run(llvm::Module &module, llvm::ModuleAnalysisManager &mam)
+{
+	bool changed = false;
+
+	this->borrowed.clear();
+	changed |= this->infer_borrows(module);
+	for (auto &function : module) {
+		if (!function.isDeclaration())
+			changed |= this->pair_retains(function);
+	}
+	changed |= this->downgrade_atomics(module);
+
+	return changed ? llvm::PreservedAnalyses::none() : llvm::PreservedAnalyses::all();
+}
+
+bool RefcountOptPass::is_borrowed(llvm::CallBase *call, unsigned int argno)
+{
+	auto callee = call->getCalledFunction();
+	return callee && this->borrowed.count({ callee, argno }) > 0;
+}
+
+// A value is safe to borrow if nothing takes ownership of it: it may be dereferenced,
+// copied into locals that are released again, or lent to other borrowing parameters.
+bool RefcountOptPass::is_borrow_safe(llvm::Value *value)
+{
+	for (auto &use : value->uses()) {
+		auto user = use.getUser();
+
+		if (llvm::isa<llvm::LoadInst>(user))
+			continue;
+
+		if (auto store = llvm::dyn_cast<llvm::StoreInst>(user); store != nullptr) {
+			if (store->getPointerOperand() != value)
+				return false;
+			continue;
+		}
+
+		if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(user); gep != nullptr) {
+			if (!this->is_borrow_safe(gep))
+				return false;
+			continue;
+		}
+
+		if (auto call = llvm::dyn_cast<llvm::CallBase>(user); call != nullptr) {
+			auto [kind, op] = RcRuntime::classify(call);
+			if (op == RcOp::Release)
+				continue;
+			if (op == RcOp::Retain) {
+				if (!this->is_borrow_safe(call))
+					return false;
+				continue;
+			}
+			if (call->isArgOperand(&use) && !call->isMustTailCall() && this->is_borrowed(call, call->getArgOperandNo(&use)))
+				continue;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+bool RefcountOptPass::infer_borrows(llvm::Module &module)
+{
+	std::map<std::pair<llvm::Function *, unsigned int>, llvm::Function *> releases;
+
+	// Candidates are owned parameters (the callee releases them) of functions whose
+	// call sites are all visible to us. Every use has to be a direct call the rewrite below
+	// can adjust, it never stops halfway with the callee changed and a caller not. A
+	// `musttail` call from `become` can't be: the caller's cleanups already ran, the
+	// reference it hands over is all that keeps the object alive, and nothing may follow it.
+	for (auto &function : module) {
+		if (function.isDeclaration() || !function.hasLocalLinkage() || function.hasAddressTaken())
+			continue;
+		auto direct = [&function](llvm::Use &use) {
+			auto call = llvm::dyn_cast<llvm::CallBase>(use.getUser());
+			return call && call->isCallee(&use) && call->getFunctionType() == function.getFunctionType() &&
+			       !call->isMustTailCall();
+		};
+		if (!llvm::all_of(function.uses(), direct))
+			continue;
+
+		for (auto &arg : function.args()) {
+			for (auto user : arg.users()) {
+				if (RcRuntime::classify(user).second == RcOp::Release) {
+					auto call = llvm::cast<llvm::CallBase>(user);
+					this->borrowed.insert({ &function, arg.getArgNo() });
+					releases[{ &function, arg.getArgNo() }] = call->getCalledFunction();
+					break;
+				}
+			}
+		}
+	}
+
+	// Optimistically assume every candidate is borrowed (so recursion works out) and
+	// drop the ones that turn out to escape until nothing changes
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto it = this->borrowed.begin(); it != this->borrowed.end();) {
+			if (!this->is_borrow_safe(it->first->getArg(it->second))) {
+				it = this->borrowed.erase(it);
+				changed = true;
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto [function, argno] : this->borrowed) {
+		auto arg = function->getArg(argno);
+		auto release = releases[{ function, argno }];
+
+		std::vector<llvm::Instruction *> dead;
+		for (auto user : arg->users()) {
+			if (RcRuntime::classify(user).second == RcOp::Release)
+				dead.push_back(llvm::cast<llvm::Instruction>(user));
+		}
+		for (auto inst : dead)
+			inst->eraseFromParent();
+
+		for (auto user : function->users()) {
+			auto call = llvm::cast<llvm::CallBase>(user);
+			auto value = call->getArgOperand(argno);
+			if (RcRuntime::classify(value).second == RcOp::Retain && value->hasOneUse()) {
+				auto retain = llvm::cast<llvm::CallBase>(value);
+				call->setArgOperand(argno, retain->getArgOperand(0));
+				retain->eraseFromParent();
+			} else {
+				// The caller handed over a reference it doesn't keep (e.g. a temporary),
+				// so it has to drop it itself now that the callee only borrows
+				auto builder = llvm::IRBuilder<>(call->getNextNode());
+				builder.CreateCall(release, { value });
+			}
+		}
+	}
+
+	return !this->borrowed.empty();
+}
+
+static llvm::Value *rc_root(llvm::Value *value)
+{
+	while (RcRuntime::classify(value).second == RcOp::Retain)
+		value = llvm::cast<llvm::CallBase>(value)->getArgOperand(0);
+
+	return value;
+}
+
+bool RefcountOptPass::pair_retains(llvm::Function &function)
+{
+	bool changed = false;
+
+	for (auto &block : function) {
+		std::vector<std::pair<llvm::CallBase *, llvm::CallBase *>> pairs;
+
+		for (auto &inst : block) {
+			if (RcRuntime::classify(&inst).second != RcOp::Retain)
+				continue;
+
+			auto retain = llvm::cast<llvm::CallBase>(&inst);
+			llvm::CallBase *release = nullptr;
+			bool consumed = false;
+			for (auto &use : retain->uses()) {
+				auto user = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+				auto call = llvm::dyn_cast<llvm::CallBase>(use.getUser());
+				auto op = RcRuntime::classify(use.getUser()).second;
+
+				if (op == RcOp::Release && user->getParent() == &block && !release) {
+					release = call;
+				} else if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::GetElementPtrInst>(user) ||
+				           (llvm::isa<llvm::StoreInst>(user) && use.getOperandNo() == 1) ||
+				           (call && op == RcOp::None && call->isArgOperand(&use) && !call->isMustTailCall() &&
+				            this->is_borrowed(call, call->getArgOperandNo(&use)))) {
+					continue;
+				} else {
+					consumed = true;
+				}
+			}
+
+			if (consumed || !release)
+				continue;
+
+			// Make sure the object can't be freed under us: nothing in between may drop
+			// another reference to the same object
+			auto root = rc_root(retain);
+			bool safe = false;
+			for (auto it = std::next(retain->getIterator()); it != block.end(); ++it) {
+				if (&*it == release) {
+					safe = true;
+					break;
+				}
+
+				auto other = llvm::dyn_cast<llvm::CallBase>(&*it);
+				if (other && RcRuntime::classify(other).second == RcOp::Release &&
+				    rc_root(other->getArgOperand(0)) == root)
+					break;
+			}
+
+			if (safe)
+				pairs.push_back({ retain, release });
+		}
+
+		for (auto [retain, release] : pairs) {
+			release->eraseFromParent();
+			retain->replaceAllUsesWith(retain->getArgOperand(0));
+			retain->eraseFromParent();
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// An object escapes its thread if it is published through memory, returned,
+// or handed to code we can't see
+bool RefcountOptPass::escapes_thread(llvm::Value *value, std::set<llvm::Value *> &visited)
+{
+	if (!visited.insert(value).second)
+		return false;
+
+	for (auto &use : value->uses()) {
+		auto user = use.getUser();
+
+		if (llvm::isa<llvm::LoadInst>(user))
+			continue;
+
+		if (auto store = llvm::dyn_cast<llvm::StoreInst>(user); store != nullptr) {
+			if (store->getPointerOperand() != value)
+				return true;
+			continue;
+		}
+
+		if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(user); gep != nullptr) {
+			if (this->escapes_thread(gep, visited))
+				return true;
+			continue;
+		}
+
+		if (auto call = llvm::dyn_cast<llvm::CallBase>(user); call != nullptr) {
+			auto op = RcRuntime::classify(call).second;
+			if (op == RcOp::Release)
+				continue;
+			if (op == RcOp::Retain) {
+				if (this->escapes_thread(call, visited))
+					return true;
+				continue;
+			}
+
+			auto callee = call->getCalledFunction();
+			if (callee && !callee->isDeclaration() && call->isArgOperand(&use)) {
+				if (this->escapes_thread(callee->getArg(call->getArgOperandNo(&use)), visited))
+					return true;
+				continue;
+			}
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool RefcountOptPass::downgrade_atomics(llvm::Module &module)
+{
+	bool changed = false;
+	auto rc_alloc = module.getFunction(RcRuntime::name(RcKind::Rc, RcOp::Alloc));
+	auto rc_retain = module.getFunction(RcRuntime::name(RcKind::Rc, RcOp::Retain));
+	auto rc_release = module.getFunction(RcRuntime::name(RcKind::Rc, RcOp::Release));
+	auto arc_alloc = module.getFunction(RcRuntime::name(RcKind::Arc, RcOp::Alloc));
+	if (!arc_alloc)
+		return false;
+
+	std::vector<llvm::CallBase *> allocs;
+	for (auto user : arc_alloc->users()) {
+		if (auto call = llvm::dyn_cast<llvm::CallBase>(user); call && call->getCalledFunction() == arc_alloc)
+			allocs.push_back(call);
+	}
+
+	for (auto alloc : allocs) {
+		std::set<llvm::Value *> visited;
+		if (this->escapes_thread(alloc, visited))
+			continue;
+
+		// Only the operations in the allocating function are rewritten, callees may
+		// also be reached by shared objects. A thread-local object may still go through
+		// the atomic operations, so mixing both is fine.
+		std::vector<llvm::Value *> worklist = { alloc };
+		std::vector<llvm::CallBase *> calls;
+		while (!worklist.empty()) {
+			auto value = worklist.back();
+			worklist.pop_back();
+			for (auto user : value->users()) {
+				auto [kind, op] = RcRuntime::classify(user);
+				if (kind != RcKind::Arc)
+					continue;
+
+				calls.push_back(llvm::cast<llvm::CallBase>(user));
+				if (op == RcOp::Retain)
+					worklist.push_back(user);
+			}
+		}
+
+		if (!rc_retain || !rc_release || !rc_alloc)
+			continue;
+
+		alloc->setCalledFunction(rc_alloc);
+		for (auto call : calls) {
+			auto op = RcRuntime::classify(call).second;
+			call->setCalledFunction(op == RcOp::Retain ? rc_retain : rc_release);
+		}
+		changed = true;
+	}
+
+	return changed;
+}
@@ -0,0 +1,59 @@
+#ifndef _REFCOUNT_HPP_
+#define _REFCOUNT_HPP_
+
+#include "llvm.hpp"
+#include <map>
+#include <set>
+#include <utility>
+
+enum class RcKind: int {
+	None,
+	Rc,  // Non-atomic reference count (`rcalloc<T>()`)
+	Arc, // Atomic reference count (`arcalloc<T>()`)
+};
+
+enum class RcOp: int {
+	None,
+	Alloc,
+	Retain,
+	Release,
+};
+
+/*
+ * Reference counted objects are laid out as an 8 byte counter followed by the payload.
+ * The pointer handed to the program always points to the payload, so an `rc<T>` can be
+ * used anywhere a plain pointer is expected.
+ *
+ * The runtime functions are emitted directly into the module (see `Codegen::rc_runtime`),
+ * so the optimizer can see through them and this pass can recognize them by name.
+ */
+struct RcRuntime {
+	static const char *name(RcKind kind, RcOp op);
+	static std::pair<RcKind, RcOp> classify(llvm::Value *value);
+};
+
+/*
+ * Removes redundant reference count traffic emitted by the naive codegen:
+ * - Borrow inference: parameters of non-exported functions that are never retained
+ *   past the call are switched from the owned to the borrowed convention, which drops the
+ *   retain in every caller and the release in the callee
+ * - Retain/release pairing: a retain whose result dies in the same block without being
+ *   consumed cancels out with its release
+ * - Atomic downgrade: `arcalloc` objects that never leave their thread use the non-atomic
+ *   counter operations
+ */
+class RefcountOptPass : public llvm::PassInfoMixin<RefcountOptPass> {
+private:
+	std::set<std::pair<llvm::Function *, unsigned int>> borrowed;
+public:
+	llvm::PreservedAnalyses run(llvm::Module &module, llvm::ModuleAnalysisManager &mam);
+private:
+	bool infer_borrows(llvm::Module &module);
+	bool pair_retains(llvm::Function &function);
+	bool downgrade_atomics(llvm::Module &module);
+	bool is_borrow_safe(llvm::Value *value);
+	bool is_borrowed(llvm::CallBase *call, unsigned int argno);
+	bool escapes_thread(llvm::Value *value, std::set<llvm::Value *> &visited);
+};
+
+#endif
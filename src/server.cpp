@@ -0,0 +1,301 @@
+#include "server.hpp"
+#include "console.hpp"
+#include "codegen.hpp"
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <optional>
+#include <cerrno>
+#include <cstdlib>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static char unlink_on_exit[sizeof(sockaddr_un::sun_path)];
+
+static void stop(int)
+{
+	unlink(unlink_on_exit);
+	_exit(0);
+}
+
+static bool read_all(int fd, void *data, size_t size)
+{
+	auto bytes = static_cast<char *>(data);
+	while (size > 0) {
+		auto n = read(fd, bytes, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		bytes += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+	auto bytes = static_cast<const char *>(data);
+	while (size > 0) {
+		auto n = write(fd, bytes, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		bytes += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool write_string(int fd, const std::string &str)
+{
+	uint32_t size = str.size();
+	return write_all(fd, &size, sizeof(size)) && write_all(fd, str.data(), str.size());
+}
+
+static std::optional<std::string> read_file(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return std::nullopt;
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+static std::string hash(const std::string &contents)
+{
+	return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(contents)));
+}
+
+std::string Server::default_socket()
+{
+	if (auto runtime = std::getenv("XDG_RUNTIME_DIR"); runtime != nullptr && *runtime != '\0')
+		return std::string(runtime) + "/1337.sock";
+	return "/tmp/1337-" + std::to_string(getuid()) + ".sock";
+}
+
+int Server::run()
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (this->socket_path.size() >= sizeof(address.sun_path)) {
+		std::cout << "[ERR] Socket path '" << this->socket_path << "' is too long" << std::endl;
+		return 1;
+	}
+	std::strcpy(address.sun_path, this->socket_path.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0) {
+		std::cout << "[ERR] Failed to create a socket: " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+
+	// Only the user running the server can connect. A socket left behind by a server that
+	// didn't exit cleanly is taken over, one that still accepts connections isn't.
+	auto mask = umask(0077);
+	auto bound = bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	if (!bound && errno == EADDRINUSE) {
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		auto running = connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+		close(probe);
+		if (running) {
+			umask(mask);
+			std::cout << "[ERR] A server is already listening on '" << this->socket_path << "'" << std::endl;
+			return 1;
+		}
+		unlink(this->socket_path.c_str());
+		bound = bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	}
+	umask(mask);
+	if (!bound || listen(listener, SOMAXCONN) != 0) {
+		std::cout << "[ERR] Failed to listen on '" << this->socket_path << "': " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+
+	std::strcpy(unlink_on_exit, this->socket_path.c_str());
+	std::signal(SIGINT, stop);
+	std::signal(SIGTERM, stop);
+	// A client going away mid response is its own problem
+	std::signal(SIGPIPE, SIG_IGN);
+
+	// Paid once here instead of by every request
+	install_console_capture();
+	initialize_target(llvm::sys::getDefaultTargetTriple());
+
+	for (size_t i = 0; i < this->threads; ++i)
+		std::thread([this]() { this->work(); }).detach();
+	std::cout << "Listening on '" << this->socket_path << "' with " << this->threads << " threads" << std::endl;
+
+	while (true) {
+		int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			std::cout << "[ERR] Failed to accept a connection: " << std::strerror(errno) << std::endl;
+			unlink(this->socket_path.c_str());
+			return 1;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->queue_mutex);
+			this->queue.push_back(fd);
+		}
+		this->queue_ready.notify_one();
+	}
+}
+
+void Server::work()
+{
+	while (true) {
+		int fd;
+		{
+			std::unique_lock<std::mutex> lock(this->queue_mutex);
+			this->queue_ready.wait(lock, [this]() { return !this->queue.empty(); });
+			fd = this->queue.front();
+			this->queue.pop_front();
+		}
+		this->handle(fd);
+		close(fd);
+	}
+}
+
+void Server::handle(int fd)
+{
+	// Nothing this compiler takes comes close to the limits, a request over them is garbage
+	uint32_t count;
+	if (!read_all(fd, &count, sizeof(count)) || count == 0 || count > (1 << 16))
+		return;
+	std::vector<std::string> strings(count);
+	for (auto &str : strings) {
+		uint32_t size;
+		if (!read_all(fd, &size, sizeof(size)) || size > (1 << 20))
+			return;
+		str.resize(size);
+		if (!read_all(fd, str.data(), size))
+			return;
+	}
+
+	Invocation invocation;
+	invocation.cwd = strings[0];
+	invocation.args.assign(strings.begin() + 1, strings.end());
+	std::string key;
+	for (auto &str : strings)
+		key += str + '\0';
+
+	auto result = this->cached(key);
+	if (!result) {
+		Result compiled;
+		ConsoleCapture capture;
+		auto start = std::filesystem::file_time_type::clock::now();
+		set_console_capture(&capture);
+		try {
+			compiled.status = run_compiler(invocation);
+		} catch (const std::exception &error) {
+			std::cout << "[ERR] " << error.what() << std::endl;
+			compiled.status = 1;
+		}
+		set_console_capture(nullptr);
+		compiled.out = std::move(capture.out);
+		compiled.err = std::move(capture.err);
+
+		if (compiled.status == 0 && invocation.deterministic)
+			this->store(key, invocation, start, compiled);
+		result = std::make_shared<const Result>(std::move(compiled));
+	}
+
+	int32_t status = result->status;
+	if (write_all(fd, &status, sizeof(status)) && write_string(fd, result->out))
+		write_string(fd, result->err);
+}
+
+// The hit is only used when the inputs still have the contents they were compiled from and
+// every output could be written again
+std::shared_ptr<const Server::Result> Server::cached(const std::string &key)
+{
+	std::shared_ptr<const Result> result;
+	{
+		std::lock_guard<std::mutex> lock(this->cache_mutex);
+		auto found = this->cache.find(key);
+		if (found == this->cache.end())
+			return nullptr;
+		result = found->second;
+	}
+
+	for (auto &[path, contents_hash] : result->inputs) {
+		auto contents = read_file(path);
+		if (!contents || hash(*contents) != contents_hash)
+			return nullptr;
+	}
+	// Identical requests can hit at the same time, each output is written to a file of its own
+	// and renamed over the path, so every one of them sees a complete file
+	static std::atomic<uint64_t> writes = 0;
+	for (auto &output : result->outputs) {
+		auto temporary = output.path + ".1337-" + std::to_string(getpid()) + "-" + std::to_string(writes++);
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		bool written = file.write(output.contents.data(), output.contents.size()).good();
+		file.close();
+		std::error_code error;
+		if (written)
+			std::filesystem::permissions(temporary, output.permissions, error);
+		if (written && !error)
+			std::filesystem::rename(temporary, output.path, error);
+		if (!written || error) {
+			std::filesystem::remove(temporary, error);
+			return nullptr;
+		}
+	}
+	return result;
+}
+
+// The inputs are hashed after the compile, which may have read an input before an edit to it.
+// An input written since the compile started isn't known to have the contents it was compiled
+// from, and the result isn't cached. File systems with coarse times get two seconds of slack.
+void Server::store(const std::string &key, const Invocation &invocation, std::filesystem::file_time_type start, Result result)
+{
+	result.bytes = key.size() + result.out.size() + result.err.size();
+	for (auto &path : invocation.inputs) {
+		auto contents = read_file(path);
+		std::error_code error;
+		auto modified = std::filesystem::last_write_time(path, error);
+		if (!contents || error || modified >= start - std::chrono::seconds(2))
+			return;
+		result.inputs.emplace_back(path, hash(*contents));
+	}
+	for (auto &path : invocation.outputs) {
+		auto contents = read_file(path);
+		if (!contents)
+			return;
+		std::error_code error;
+		auto permissions = std::filesystem::status(path, error).permissions();
+		if (error)
+			return;
+		result.bytes += contents->size();
+		result.outputs.push_back({ path, std::move(*contents), permissions });
+	}
+	if (result.bytes > cache_limit)
+		return;
+
+	std::lock_guard<std::mutex> lock(this->cache_mutex);
+	if (auto previous = this->cache.find(key); previous != this->cache.end()) {
+		this->cache_bytes -= previous->second->bytes;
+		this->cache_order.remove(key);
+	}
+	this->cache_bytes += result.bytes;
+	this->cache[key] = std::make_shared<const Result>(std::move(result));
+	this->cache_order.push_back(key);
+
+	while (this->cache_bytes > cache_limit) {
+		auto oldest = this->cache.find(this->cache_order.front());
+		this->cache_bytes -= oldest->second->bytes;
+		this->cache.erase(oldest);
+		this->cache_order.pop_front();
+	}
+}
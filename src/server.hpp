@@ -0,0 +1,80 @@
+#ifndef _SERVER_HPP_
+#define _SERVER_HPP_
+
+#include "driver.hpp"
+#include <map>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <filesystem>
+#include <condition_variable>
+
+/*
+ * `1337 --server`, a daemon compiling for `1337c` (client/client.c), so editors and build
+ * farms running the compiler on many small files pay the process startup and the LLVM
+ * initialization once instead of every time.
+ *
+ * It listens on a Unix domain socket, one connection is one request: the working directory of
+ * the client and its arguments, the same ones the command line takes. The requests run on a
+ * pool of threads through `run_compiler`, like the command line, where every file gets its own
+ * `Codegen` and with it its own `LLVMContext`. What a request prints is captured
+ * (console.hpp) and sent back with its exit code.
+ *
+ * Objects are cached in memory: a request with the same working directory and arguments as an
+ * earlier one, whose inputs still have the same contents, gets the files that one wrote
+ * written again without compiling anything.
+ *
+ * Request:  u32 count, then count times a u32 length and the bytes, the working directory first
+ * Response: i32 exit code, then a u32 length and the bytes of stdout, and the same for stderr
+ * All integers are in the byte order of the machine, both ends are on it.
+ */
+class Server {
+private:
+	struct Output {
+		std::string path;
+		std::string contents;
+		std::filesystem::perms permissions; // An executable from `-o prog` stays one
+	};
+
+	struct Result {
+		int status = 0;
+		std::string out;
+		std::string err;
+		std::vector<std::pair<std::string, std::string>> inputs; // Path and hash of the contents
+		std::vector<Output> outputs;
+		size_t bytes = 0;
+	};
+
+	std::string socket_path;
+	size_t threads;
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_ready;
+	std::deque<int> queue; // Accepted connections
+
+	std::mutex cache_mutex;
+	std::map<std::string, std::shared_ptr<const Result>> cache; // By working directory and arguments
+	std::list<std::string> cache_order; // Oldest first, evicted once the cache is over its size
+	size_t cache_bytes = 0;
+	static constexpr size_t cache_limit = 256 << 20;
+public:
+	inline Server(std::string socket_path, size_t threads)
+		: socket_path(std::move(socket_path)), threads(threads)
+	{}
+
+	// Only returns if the socket can't be set up
+	int run();
+	// `$XDG_RUNTIME_DIR/1337.sock`, or one per user in /tmp. The client looks in the same place.
+	static std::string default_socket();
+private:
+	void work();
+	void handle(int fd);
+	std::shared_ptr<const Result> cached(const std::string &key);
+	void store(const std::string &key, const Invocation &invocation, std::filesystem::file_time_type start, Result result);
+};
+
+#endif
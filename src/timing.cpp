@@ -0,0 +1,191 @@
+#include "timing.hpp"
+#include <new>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <time.h>
+#include <sys/resource.h>
+
+// Counted by every allocation of the thread, read by `PhaseSample::now`
+static thread_local uint64_t thread_allocations = 0;
+static thread_local uint64_t thread_allocated_bytes = 0;
+
+static void *allocate(std::size_t size, std::size_t align)
+{
+	++thread_allocations;
+	thread_allocated_bytes += size;
+
+	// There's no recovering from running out of memory while compiling, it aborts instead of throwing
+	while (true) {
+		void *ptr = align > alignof(std::max_align_t) ?
+			std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1)) :
+			std::malloc(std::max<std::size_t>(size, 1));
+		if (ptr)
+			return ptr;
+
+		auto handler = std::get_new_handler();
+		if (!handler)
+			std::abort();
+		handler();
+	}
+}
+
+// The array and `nothrow` forms go through these
+void *operator new(std::size_t size)
+{
+	return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+	return allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+	std::free(ptr);
+}
+
+PhaseSample PhaseSample::now()
+{
+	struct timespec cpu;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	auto wall = std::chrono::steady_clock::now().time_since_epoch();
+
+	return {
+		static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()),
+		static_cast<uint64_t>(cpu.tv_sec) * 1000000000 + static_cast<uint64_t>(cpu.tv_nsec),
+		thread_allocations,
+		thread_allocated_bytes,
+	};
+}
+
+PhaseSample PhaseSample::now_wall()
+{
+	auto wall = std::chrono::steady_clock::now().time_since_epoch();
+	auto wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count());
+	return { wall_ns, wall_ns, thread_allocations, thread_allocated_bytes };
+}
+
+uint64_t TimeReport::peak_rss_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+void TimeReport::record(PhaseSpan span)
+{
+	span.peak_rss_kb = TimeReport::peak_rss_kb();
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	span.thread = this->threads.emplace(std::this_thread::get_id(), this->threads.size()).first->second;
+	this->spans.push_back(std::move(span));
+}
+
+static void print_rows(const std::string &title, std::vector<std::pair<std::string, PhaseSample>> rows, size_t limit)
+{
+	std::sort(rows.begin(), rows.end(), [](auto &a, auto &b) { return a.second.wall_ns > b.second.wall_ns; });
+	if (rows.size() > limit)
+		rows.resize(limit);
+
+	std::cout << title << std::endl;
+	std::cout << "  " << std::setw(10) << "wall ms" << std::setw(10) << "cpu ms" << std::setw(12) << "allocs"
+		<< std::setw(12) << "alloc KiB" << "  name" << std::endl;
+	for (auto &[name, cost] : rows) {
+		std::cout << "  " << std::fixed << std::setprecision(3)
+			<< std::setw(10) << cost.wall_ns / 1e6 << std::setw(10) << cost.cpu_ns / 1e6
+			<< std::setw(12) << cost.allocations << std::setw(12) << cost.allocated_bytes / 1024
+			<< "  " << name << std::endl;
+	}
+}
+
+// Phases and passes are summed over the files, so with `-j N` their wall time can exceed the total
+void TimeReport::print()
+{
+	std::lock_guard<std::mutex> guard(this->lock);
+
+	std::map<std::string, PhaseSample> phases, passes;
+	std::vector<std::pair<std::string, PhaseSample>> decls;
+	for (auto &span : this->spans) {
+		if (span.category == "phase")
+			phases[span.name] += span.cost;
+		else if (span.category == "pass")
+			passes[span.name] += span.cost;
+		else if (span.category == "decl")
+			decls.emplace_back(span.file + ": " + span.name, span.cost);
+	}
+
+	auto total = PhaseSample::now().wall_ns - this->start_ns;
+	std::cout << "===== Time report: " << std::fixed << std::setprecision(3) << total / 1e6 << " ms total, "
+		<< TimeReport::peak_rss_kb() / 1024 << " MiB peak RSS =====" << std::endl;
+	print_rows("Phases", { phases.begin(), phases.end() }, phases.size());
+	print_rows("Passes (slowest 20)", { passes.begin(), passes.end() }, 20);
+	print_rows("Declarations (slowest 20)", decls, 20);
+}
+
+static std::string escape(const std::string &str)
+{
+	std::ostringstream ss;
+	for (unsigned char c : str) {
+		if (c == '"' || c == '\\')
+			ss << '\\' << c;
+		else if (c < 0x20)
+			ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+		else
+			ss << c;
+	}
+	return ss.str();
+}
+
+// Complete ("X") events in microseconds since the report started, the peak RSS is a counter ("C") over the phases
+bool TimeReport::write_trace(const std::string &path)
+{
+	std::ofstream out(path);
+	if (!out) {
+		std::cout << "[ERR] Failed to open trace file '" << path << "'" << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (auto &span : this->spans) {
+		auto start = (span.start_ns - this->start_ns) / 1000;
+		out << (first ? "" : ",") << "\n{\"name\":\"" << escape(span.name) << "\",\"cat\":\"" << span.category
+			<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread << ",\"ts\":" << start
+			<< ",\"dur\":" << span.cost.wall_ns / 1000 << ",\"args\":{\"file\":\"" << escape(span.file)
+			<< "\",\"cpu_us\":" << span.cost.cpu_ns / 1000 << ",\"allocations\":" << span.cost.allocations
+			<< ",\"allocated_bytes\":" << span.cost.allocated_bytes << "}}";
+		if (span.category == "phase") {
+			out << ",\n{\"name\":\"peak RSS\",\"ph\":\"C\",\"pid\":1,\"ts\":" << start + span.cost.wall_ns / 1000
+				<< ",\"args\":{\"KiB\":" << span.peak_rss_kb << "}}";
+		}
+		first = false;
+	}
+	out << "\n]}" << std::endl;
+
+	std::cout << "Successfully created trace file '" << path << "'" << std::endl;
+
+	return true;
+}
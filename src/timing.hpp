@@ -0,0 +1,112 @@
+#ifndef _TIMING_HPP_
+#define _TIMING_HPP_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Where the compiler spends its time, for `-ftime-report` and `-ftime-trace=<file>`.
+ *
+ * A span is one run of a phase (lex, parse, declare, generate, optimize, dump, emit, link),
+ * an optimization pass, or the declaring and generating of one top level declaration.
+ * It costs wall time, CPU time of its thread, and the allocations its thread made meanwhile.
+ * Allocations are counted by the global `operator new` in `timing.cpp`, per thread, so the
+ * files compiled by `-j N` threads don't count each other's.
+ *
+ * The report sums the spans by phase and pass, lists the slowest declarations and the peak
+ * RSS. The trace has every span as a Chrome `trace_event`, one row per thread, and opens in
+ * chrome://tracing or Perfetto.
+ */
+struct PhaseSample {
+	uint64_t wall_ns = 0;
+	uint64_t cpu_ns = 0; // Of the calling thread
+	uint64_t allocations = 0; // Of the calling thread
+	uint64_t allocated_bytes = 0;
+
+	static PhaseSample now();
+	// Without the system call for the CPU time, the wall time stands in for it. For spans
+	// too short to pay for `now()`, like lexing one token.
+	static PhaseSample now_wall();
+
+	inline PhaseSample operator-(const PhaseSample &other) const
+	{
+		return { this->wall_ns - other.wall_ns, this->cpu_ns - other.cpu_ns,
+		         this->allocations - other.allocations, this->allocated_bytes - other.allocated_bytes };
+	}
+
+	inline PhaseSample &operator+=(const PhaseSample &other)
+	{
+		this->wall_ns += other.wall_ns;
+		this->cpu_ns += other.cpu_ns;
+		this->allocations += other.allocations;
+		this->allocated_bytes += other.allocated_bytes;
+		return *this;
+	}
+};
+
+struct PhaseSpan {
+	std::string category; // "phase", "pass", "passes" (a pass running other passes) or "decl"
+	std::string name;
+	std::string file;
+	uint64_t start_ns = 0; // Wall time
+	PhaseSample cost;
+	uint64_t peak_rss_kb = 0; // When the span ended
+	size_t thread = 0;
+};
+
+class TimeReport {
+private:
+	std::mutex lock; // Spans come from every compiling thread
+	std::vector<PhaseSpan> spans;
+	std::map<std::thread::id, size_t> threads;
+	uint64_t start_ns;
+public:
+	inline TimeReport()
+		: start_ns(PhaseSample::now().wall_ns)
+	{}
+
+	void record(PhaseSpan span);
+	void print();
+	bool write_trace(const std::string &path);
+
+	static uint64_t peak_rss_kb();
+};
+
+// Records a span from its construction to its destruction, there's nothing to record without a report
+class PhaseTimer {
+private:
+	TimeReport *report;
+	PhaseSpan span;
+	PhaseSample start;
+public:
+	inline PhaseTimer(TimeReport *report, std::string category, std::string name, std::string file)
+		: report(report)
+	{
+		if (!report)
+			return;
+
+		this->span.category = std::move(category);
+		this->span.name = std::move(name);
+		this->span.file = std::move(file);
+		this->start = PhaseSample::now();
+	}
+
+	PhaseTimer(const PhaseTimer &) = delete;
+	PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+	inline ~PhaseTimer()
+	{
+		if (!this->report)
+			return;
+
+		this->span.start_ns = this->start.wall_ns;
+		this->span.cost = PhaseSample::now() - this->start;
+		this->report->record(std::move(this->span));
+	}
+};
+
+#endif